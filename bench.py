@@ -0,0 +1,130 @@
+#!/usr/bin/env python
+
+import argparse
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+
+'''
+Benchmark the shaders of the examples directory, rendering them headless,
+e.g. with llvmpipe on any Linux machine, for a fixed number of frames, at a
+fixed timestep and resolution, so that the same frames are rendered on
+every run.
+
+The frame time percentiles, along with the time to compile and link the
+program, which is always built from its sources, bypassing the program
+binary cache, are written to a JSON results file, and compared against a
+baseline results file, if any, flagging the shaders that are slower than
+the baseline by more than the tolerance, or that don't render anymore.
+'''
+
+parser = argparse.ArgumentParser(description='Benchmark the example shaders')
+parser.add_argument('shaders', metavar='SHADER', type=str, nargs='*',
+                    help='the shaders to benchmark (default: examples/*.glsl)')
+parser.add_argument('--glsl', type=str, default='./glsl', help='the path to the glsl executable')
+parser.add_argument('--frames', type=int, default=100, help='the number of frames to render')
+parser.add_argument('--fps', type=int, default=60, help='the fixed frame rate iTime is derived from')
+parser.add_argument('--size', type=str, default='320x180', help='the size of the framebuffers')
+parser.add_argument('--timeout', type=int, default=300, help='the timeout of each shader, in seconds')
+parser.add_argument('--output', type=str, default='bench.json', help='the results file')
+parser.add_argument('--baseline', type=str, help='the results file to compare against')
+parser.add_argument('--tolerance', type=float, default=10,
+                    help='the slowdown over the baseline to flag, in percent')
+args = parser.parse_args()
+
+# the metrics compared against the baseline:
+METRICS = ['p50', 'p95', 'p99', 'build']
+
+
+def bench(shader):
+    cmd = [args.glsl, '--headless=' + args.size, '--frames={}'.format(args.frames),
+           '--fixed-fps={}'.format(args.fps), '--stats=json', '--no-cache', '--build-info', shader]
+    try:
+        process = subprocess.run(cmd, stdin=subprocess.DEVNULL, stdout=subprocess.PIPE,
+                                 stderr=subprocess.STDOUT, timeout=args.timeout)
+    except subprocess.TimeoutExpired:
+        return {'error': 'timed out after {} sec'.format(args.timeout)}
+
+    output = process.stdout.decode(errors='replace')
+    result = {}
+    for line in output.splitlines():
+        build = re.match(r'Built the program in ([0-9.]+) ms: vertex shader ([0-9.]+) ms, '
+                         r'fragment shader ([0-9.]+) ms, link ([0-9.]+) ms, first draw ([0-9.]+) ms', line)
+        if build:
+            result.update(zip(['build', 'compile_vs', 'compile_fs', 'link', 'first_draw'],
+                              [float(t) for t in build.groups()]))
+        elif line.startswith('{'):
+            # the last statistics are the ones of the whole run:
+            stats = json.loads(line)
+            result.update({k: stats[k] for k in ['frames', 'p50', 'p95', 'p99', 'max']})
+
+    if process.returncode or 'p50' not in result:
+        lines = output.strip().splitlines()
+        return {'error': lines[-1] if lines else 'exited with {}'.format(process.returncode)}
+
+    return result
+
+
+def compare(results, baseline):
+    regressions = []
+    for name, result in sorted(results.items()):
+        base = baseline.get(name)
+        if not base or 'error' in base:
+            continue
+        if 'error' in result:
+            regressions.append('{}: {}'.format(name, result['error']))
+            continue
+        for metric in METRICS:
+            if metric not in base or metric not in result or base[metric] <= 0:
+                continue
+            change = (result[metric] - base[metric]) / base[metric] * 100
+            if change > args.tolerance:
+                regressions.append('{}: {} {:.3f} ms -> {:.3f} ms (+{:.1f}%)'.format(
+                    name, metric, base[metric], result[metric], change))
+    return regressions
+
+
+shaders = args.shaders or sorted(glob.glob(os.path.join(os.path.dirname(__file__), 'examples', '*.glsl')))
+
+print('{:<40} {:>10} {:>10} {:>10} {:>10}'.format('shader (ms)', 'build', 'p50', 'p95', 'p99'))
+results = {}
+for shader in shaders:
+    name = os.path.basename(shader)
+    result = results[name] = bench(shader)
+    if 'error' in result:
+        print('{:<40} {}'.format(name, result['error']))
+    else:
+        print('{:<40} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}'.format(
+            name, result.get('build', 0), result['p50'], result['p95'], result['p99']))
+
+with open(args.output, 'w') as f:
+    json.dump({'size': args.size, 'frames': args.frames, 'fps': args.fps,
+               'shaders': results}, f, indent=2, sort_keys=True)
+print('Wrote the results of {} shader(s) to {}'.format(len(results), args.output))
+
+if not args.baseline:
+    sys.exit(0)
+
+if not os.path.exists(args.baseline):
+    print('No baseline at {}, to compare against'.format(args.baseline))
+    sys.exit(0)
+
+with open(args.baseline) as f:
+    baseline = json.load(f)
+
+if (baseline['size'], baseline['frames'], baseline['fps']) != (args.size, args.frames, args.fps):
+    sys.exit('The baseline has {} frames of {} at {} fps, instead of {} frames of {} at {} fps'.format(
+        baseline['frames'], baseline['size'], baseline['fps'], args.frames, args.size, args.fps))
+
+regressions = compare(results, baseline['shaders'])
+if regressions:
+    print('{} regression(s) over {}, with a tolerance of {}%:'.format(
+        len(regressions), args.baseline, args.tolerance))
+    for regression in regressions:
+        print('    ' + regression)
+    sys.exit(1)
+
+print('No regression over {}, with a tolerance of {}%'.format(args.baseline, args.tolerance))
@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <GLES3/gl3.h>
+
+#include "common.h"
+
+/* Module to stream the rendered frames out, as YUV4MPEG2, or raw RGBA, I420
+ * or NV12, or to write them to PNG files.
+ *
+ * Call capture_frame() once the frame is drawn, with its framebuffer still
+ * bound. The pixels are read back into a ring of pixel buffer objects, so
+ * that glReadPixels() returns right away, and each buffer is only mapped
+ * two frames later, once the GPU is done with it, while it's busy filling
+ * the next ones. The rendering never waits for the readback to complete,
+ * unless the frames cannot be written out fast enough.
+ */
+
+#define CAPTURE_BUFFERS 3
+
+enum capture_format {
+	CAPTURE_RGBA,
+	CAPTURE_Y4M,
+	CAPTURE_I420,
+	CAPTURE_NV12,
+	CAPTURE_PNG,
+};
+
+static const struct {
+	const char *ext;
+	enum capture_format format;
+} formats[] = {
+	{ ".y4m",  CAPTURE_Y4M },
+	{ ".yuv",  CAPTURE_I420 },
+	{ ".i420", CAPTURE_I420 },
+	{ ".nv12", CAPTURE_NV12 },
+	{ ".png",  CAPTURE_PNG },
+};
+
+static struct {
+	bool active;
+	FILE *file;
+	const char *path;  /* formatted with the frame index, for PNG */
+	enum capture_format format;
+	capture_sink sink; /* to hand the frames to, instead of writing them */
+
+	unsigned width, height;
+	size_t size;    /* of a frame, in RGBA */
+
+	GLuint pbos[CAPTURE_BUFFERS];
+	GLsync fences[CAPTURE_BUFFERS];
+	unsigned frames[CAPTURE_BUFFERS];  /* the indices of the frames */
+	unsigned head;  /* number of frames read back */
+	unsigned tail;  /* number of frames written */
+
+	uint8_t *frame; /* the converted frame, in YUV */
+} capture;
+
+/* The PNG files are named after the path formatted with the frame index,
+ * so it must contain a single integer conversion, e.g. frame%04d.png, and
+ * nothing else to be formatted:
+ */
+static bool valid_png_path(const char *path)
+{
+	unsigned conversions = 0;
+
+	for (const char *s = strchr(path, '%'); s; s = strchr(s, '%')) {
+		s++;
+		while (isdigit((unsigned char) *s))
+			s++;
+		if (*s != 'd' && *s != 'u')
+			return false;
+		conversions++;
+	}
+
+	return conversions == 1;
+}
+
+/* Open the output before anything is printed, as the standard output is
+ * redirected to stderr when streaming to it:
+ */
+int open_capture(const char *path)
+{
+	const char *ext = strrchr(path, '.');
+
+	/* the frames are handed to the sink instead: */
+	if (capture.sink)
+		return 0;
+
+	if (!strcmp(path, "-")) {
+		/* print the reports to stderr instead, not to corrupt the
+		 * stream:
+		 */
+		fflush(stdout);
+		int fd = dup(STDOUT_FILENO);
+		if (fd >= 0 && dup2(STDERR_FILENO, STDOUT_FILENO) >= 0)
+			capture.file = fdopen(fd, "w");
+		capture.format = CAPTURE_Y4M;
+	} else {
+		for (unsigned i = 0; ext && i < ARRAY_SIZE(formats); i++) {
+			if (!strcmp(ext, formats[i].ext))
+				capture.format = formats[i].format;
+		}
+		/* the PNG files are opened for each frame: */
+		if (capture.format == CAPTURE_PNG) {
+			if (!valid_png_path(path)) {
+				printf("the path of the PNG files must contain the frame index, "
+				       "as a single %%d or %%u conversion, e.g. frame%%04d.png: %s\n", path);
+				return -1;
+			}
+			capture.path = path;
+			capture.active = true;
+			return 0;
+		}
+		capture.file = fopen(path, "w");
+	}
+	if (!capture.file) {
+		printf("failed to open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	capture.active = true;
+
+	return 0;
+}
+
+/* Hand the frames read back to the sink, as bottom-up RGBA pixels, instead
+ * of writing them out, e.g. to merge the frames rendered by several processes:
+ */
+void capture_to_sink(capture_sink sink)
+{
+	/* forget about the output of the coordinator, if forked from it: */
+	capture.file = NULL;
+	capture.frame = NULL;
+
+	capture.sink = sink;
+	capture.format = CAPTURE_RGBA;
+	capture.active = true;
+}
+
+/* whether the frames are written to a file each, in any order: */
+bool capture_per_frame(void)
+{
+	return capture.active && capture.format == CAPTURE_PNG;
+}
+
+/* Prepare the output for frames of the given size, without reading them
+ * back, i.e. to write them with capture_pixels():
+ */
+int start_capture(unsigned width, unsigned height, unsigned fps)
+{
+	if (!capture.active)
+		return 0;
+
+	capture.width = width;
+	capture.height = height;
+	capture.size = (size_t) width * height * 4;
+
+	if (capture.format != CAPTURE_RGBA && capture.format != CAPTURE_PNG) {
+		capture.frame = malloc(yuv_frame_size(width, height));
+		if (!capture.frame) {
+			printf("failed to allocate the capture buffer\n");
+			fclose(capture.file);
+			capture.active = false;
+			return -1;
+		}
+
+		init_convert(0);
+	}
+
+	if (capture.format == CAPTURE_Y4M) {
+		/* 4:2:0, with the chroma sampled at the center of each
+		 * 2x2 block of pixels:
+		 */
+		fprintf(capture.file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n",
+		        width, height, fps);
+	}
+
+	return 0;
+}
+
+int init_capture(unsigned width, unsigned height, unsigned fps)
+{
+	int ret;
+
+	ret = start_capture(width, height, fps);
+	if (ret < 0 || !capture.active)
+		return ret;
+
+	glGenBuffers(CAPTURE_BUFFERS, capture.pbos);
+	for (unsigned i = 0; i < CAPTURE_BUFFERS; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, capture.size, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return 0;
+}
+
+static bool write_png(const uint8_t *pixels, unsigned frame)
+{
+	size_t stride = (size_t) capture.width * 4;
+	char path[PATH_MAX];
+	struct png png;
+	bool written;
+	FILE *file;
+
+	snprintf(path, sizeof(path), capture.path, frame);
+	file = fopen(path, "w");
+	if (!file) {
+		printf("failed to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	/* from the bottom-up rows glReadPixels() returns: */
+	written = png_begin(&png, file, capture.width, capture.height) &&
+	          png_write_rows(&png, pixels + (capture.height - 1) * stride,
+	                         -(ptrdiff_t) stride, capture.height);
+	written = png_end(&png) && written;
+
+	return !fclose(file) && written;
+}
+
+static bool write_pixels(const uint8_t *pixels, unsigned frame)
+{
+	size_t stride = (size_t) capture.width * 4;
+
+	if (capture.sink) {
+		capture.sink(pixels, frame);
+		return true;
+	}
+
+	if (capture.format == CAPTURE_PNG)
+		return write_png(pixels, frame);
+
+	if (capture.format != CAPTURE_RGBA) {
+		/* from the bottom-up rows glReadPixels() returns: */
+		convert_frame(pixels + (capture.height - 1) * stride, -(ptrdiff_t) stride,
+		              capture.width, capture.height,
+		              capture.format == CAPTURE_NV12 ? YUV_NV12 : YUV_I420, capture.frame);
+
+		if (capture.format == CAPTURE_Y4M && fputs("FRAME\n", capture.file) < 0)
+			return false;
+
+		return fwrite(capture.frame, yuv_frame_size(capture.width, capture.height),
+		              1, capture.file) == 1;
+	}
+
+	for (unsigned y = capture.height; y-- > 0; ) {
+		if (fwrite(pixels + y * stride, stride, 1, capture.file) != 1)
+			return false;
+	}
+
+	return true;
+}
+
+static void stop_capture(void)
+{
+	while (capture.tail != capture.head) {
+		glDeleteSync(capture.fences[capture.tail % CAPTURE_BUFFERS]);
+		capture.tail++;
+	}
+
+	/* not read back by this process, for capture_pixels(): */
+	if (capture.pbos[0])
+		glDeleteBuffers(CAPTURE_BUFFERS, capture.pbos);
+	if (capture.frame)
+		finish_convert();
+	free(capture.frame);
+	if (capture.file)
+		fclose(capture.file);
+	capture.active = false;
+}
+
+/* Write the oldest frame out, waiting for its readback to complete: */
+static void write_frame(void)
+{
+	unsigned slot = capture.tail++ % CAPTURE_BUFFERS;
+	unsigned frame = capture.frames[slot];
+	const uint8_t *pixels;
+	bool written = false;
+
+	glClientWaitSync(capture.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+	glDeleteSync(capture.fences[slot]);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[slot]);
+	pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, capture.size, GL_MAP_READ_BIT);
+	if (pixels) {
+		written = write_pixels(pixels, frame);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (!written) {
+		printf("failed to write the captured frame%s\n", pixels ? "" : ", mapping failed");
+		stop_capture();
+	}
+}
+
+/* Write the frame, as bottom-up RGBA pixels: */
+bool capture_pixels(const uint8_t *pixels, unsigned frame)
+{
+	if (!capture.active)
+		return false;
+
+	if (!write_pixels(pixels, frame)) {
+		printf("failed to write the captured frame\n");
+		stop_capture();
+		return false;
+	}
+
+	return true;
+}
+
+void capture_frame(unsigned frame)
+{
+	unsigned slot = capture.head % CAPTURE_BUFFERS;
+
+	if (!capture.active)
+		return;
+
+	capture.frames[slot] = frame;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[slot]);
+	glReadPixels(0, 0, capture.width, capture.height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	capture.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	capture.head++;
+
+	/* write the frame read back two frames ago out, to free its buffer
+	 * for the next frame, while the GPU is busy with this one:
+	 */
+	if (capture.head - capture.tail == CAPTURE_BUFFERS)
+		write_frame();
+}
+
+void finish_capture(void)
+{
+	if (!capture.active)
+		return;
+
+	while (capture.active && capture.tail != capture.head)
+		write_frame();
+
+	if (capture.active)
+		stop_capture();
+}
@@ -25,6 +25,7 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -52,7 +53,7 @@ gbm_bo_create_with_modifiers(struct gbm_device *gbm,
 				const uint64_t *modifiers,
 				const unsigned int count);
 
-const struct gbm *init_gbm_device(const struct drm *drm, uint32_t format)
+const struct gbm *init_gbm_device(const struct drm *drm, uint32_t format, unsigned buffers)
 {
 	gbm.drm = drm;
 
@@ -66,6 +67,24 @@ const struct gbm *init_gbm_device(const struct drm *drm, uint32_t format)
 	gbm.width = drm->mode->hdisplay;
 	gbm.height = drm->mode->vdisplay;
 	gbm.surface = NULL;
+	gbm.num_bos = buffers;
+
+	return &gbm;
+}
+
+/* Describe the framebuffers to render into, without any GBM device, on
+ * the given DRM device if any, or on the default one otherwise:
+ */
+const struct gbm *init_gbm_headless(const char *device, int width, int height, unsigned buffers)
+{
+	gbm.drm = NULL;
+	gbm.dev = NULL;
+	gbm.device = device;
+	gbm.format = DRM_FORMAT_ABGR8888;
+	gbm.width = width;
+	gbm.height = height;
+	gbm.surface = NULL;
+	gbm.num_bos = buffers;
 
 	return &gbm;
 }
@@ -136,7 +155,7 @@ static struct gbm_bo *init_gbm_bo(const uint64_t *modifiers,
 static int init_gbm_buffer_objects(const uint64_t *modifiers,
                                    const unsigned int count)
 {
-	for (unsigned i = 0; i < ARRAY_SIZE(gbm.bos); i++) {
+	for (unsigned i = 0; i < gbm.num_bos; i++) {
 		gbm.bos[i] = init_gbm_bo(modifiers, count);
 		if (!gbm.bos[i])
 			return -1;
@@ -304,6 +323,33 @@ static bool create_framebuffer(const struct egl *egl, struct gbm_bo *bo,
 	return true;
 }
 
+static bool create_texture_framebuffer(int width, int height, struct framebuffer *fb)
+{
+	fb->image = EGL_NO_IMAGE_KHR;
+
+	glGenTextures(1, &fb->tex);
+	glBindTexture(GL_TEXTURE_2D, fb->tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+			GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &fb->fb);
+	glBindFramebuffer(GL_FRAMEBUFFER, fb->fb);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+			fb->tex, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("failed framebuffer check for created target buffer\n");
+		glDeleteFramebuffers(1, &fb->fb);
+		glDeleteTextures(1, &fb->tex);
+		return false;
+	}
+
+	return true;
+}
+
 int init_egl_modifiers(struct egl *egl, const struct drm *drm,
                        unsigned int format)
 {
@@ -388,6 +434,69 @@ int init_egl_modifiers(struct egl *egl, const struct drm *drm,
 	return 0;
 }
 
+static bool same_drm_device(drmDevicePtr device, const char *file)
+{
+	for (int i = 0; i < DRM_NODE_MAX; i++) {
+		if ((device->available_nodes & (1 << i)) && !strcmp(device->nodes[i], file))
+			return true;
+	}
+	return false;
+}
+
+/* Get the display of the EGL device of the given DRM device, primary or
+ * render node, to render headless on it:
+ */
+static EGLDisplay get_device_display(const char *path, const char *egl_exts_client)
+{
+	PFNEGLQUERYDEVICESEXTPROC eglQueryDevicesEXT;
+	PFNEGLQUERYDEVICESTRINGEXTPROC eglQueryDeviceStringEXT;
+	EGLDeviceEXT devices[16];
+	EGLDisplay display = EGL_NO_DISPLAY;
+	drmDevicePtr device;
+	EGLint num_devices;
+	int fd, ret;
+
+	if (!egl.eglGetPlatformDisplayEXT ||
+	    !has_ext(egl_exts_client, "EGL_EXT_device_enumeration") ||
+	    !has_ext(egl_exts_client, "EGL_EXT_platform_device")) {
+		printf("EGL_EXT_platform_device not supported, can't render on %s\n", path);
+		return EGL_NO_DISPLAY;
+	}
+	eglQueryDevicesEXT = (void *)eglGetProcAddress("eglQueryDevicesEXT");
+	eglQueryDeviceStringEXT = (void *)eglGetProcAddress("eglQueryDeviceStringEXT");
+
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		printf("could not open %s: %s\n", path, strerror(errno));
+		return EGL_NO_DISPLAY;
+	}
+	ret = drmGetDevice2(fd, 0, &device);
+	close(fd);
+	if (ret) {
+		printf("%s is not a DRM device\n", path);
+		return EGL_NO_DISPLAY;
+	}
+
+	if (!eglQueryDevicesEXT(ARRAY_SIZE(devices), devices, &num_devices))
+		num_devices = 0;
+	for (int i = 0; i < num_devices && display == EGL_NO_DISPLAY; i++) {
+		const char *exts = eglQueryDeviceStringEXT(devices[i], EGL_EXTENSIONS);
+		const char *file = NULL;
+
+		if (has_ext(exts, "EGL_EXT_device_drm_render_node"))
+			file = eglQueryDeviceStringEXT(devices[i], EGL_DRM_RENDER_NODE_FILE_EXT);
+		if (!file && has_ext(exts, "EGL_EXT_device_drm"))
+			file = eglQueryDeviceStringEXT(devices[i], EGL_DRM_DEVICE_FILE_EXT);
+		if (file && same_drm_device(device, file))
+			display = egl.eglGetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, devices[i], NULL);
+	}
+	drmFreeDevice(&device);
+
+	if (display == EGL_NO_DISPLAY)
+		printf("no EGL device found for %s\n", path);
+	return display;
+}
+
 const struct egl * init_egl(const struct gbm *gbm, uint64_t modifier, bool surfaceless)
 {
 	EGLint major, minor;
@@ -397,8 +506,11 @@ const struct egl * init_egl(const struct gbm *gbm, uint64_t modifier, bool surfa
 		EGL_NONE
 	};
 
+	/* without GBM device, render into framebuffer objects: */
+	bool headless = !gbm->dev;
+
 	const EGLint config_attribs[] = {
-		EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+		EGL_SURFACE_TYPE, headless ? EGL_PBUFFER_BIT : EGL_WINDOW_BIT,
 		EGL_RED_SIZE, 1,
 		EGL_GREEN_SIZE, 1,
 		EGL_BLUE_SIZE, 1,
@@ -428,7 +540,19 @@ const struct egl * init_egl(const struct gbm *gbm, uint64_t modifier, bool surfa
 	egl_exts_client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
 	get_proc_client(EGL_EXT_platform_base, eglGetPlatformDisplayEXT);
 
-	if (egl.eglGetPlatformDisplayEXT) {
+	if (headless && gbm->device) {
+		egl.display = get_device_display(gbm->device, egl_exts_client);
+		if (egl.display == EGL_NO_DISPLAY)
+			return NULL;
+	} else if (headless) {
+		if (egl.eglGetPlatformDisplayEXT &&
+		    has_ext(egl_exts_client, "EGL_MESA_platform_surfaceless")) {
+			egl.display = egl.eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA,
+					EGL_DEFAULT_DISPLAY, NULL);
+		} else {
+			egl.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		}
+	} else if (egl.eglGetPlatformDisplayEXT) {
 		egl.display = egl.eglGetPlatformDisplayEXT(EGL_PLATFORM_GBM_KHR,
 				gbm->dev, NULL);
 	} else {
@@ -467,8 +591,8 @@ const struct egl * init_egl(const struct gbm *gbm, uint64_t modifier, bool surfa
 		return NULL;
 	}
 
-	if (!egl_choose_config(egl.display, config_attribs, gbm->format,
-			&egl.config)) {
+	if (!egl_choose_config(egl.display, config_attribs,
+			headless ? 0 : gbm->format, &egl.config)) {
 		printf("Failed to choose EGL config\n");
 		return NULL;
 	}
@@ -480,7 +604,7 @@ const struct egl * init_egl(const struct gbm *gbm, uint64_t modifier, bool surfa
 		return NULL;
 	}
 
-	if (egl.modifiers_supported) {
+	if (egl.modifiers_supported && !headless) {
 		if (modifier == DRM_FORMAT_MOD_INVALID &&
 		    init_egl_modifiers(&egl, gbm->drm, gbm->format)) {
 			printf("Not using modifiers\n");
@@ -496,7 +620,9 @@ const struct egl * init_egl(const struct gbm *gbm, uint64_t modifier, bool surfa
 		init_gbm = init_gbm_surface;
 	}
 
-	if (egl.num_modifiers) {
+	if (headless) {
+		res = 0;
+	} else if (egl.num_modifiers) {
 		res = init_gbm(egl.modifiers, egl.num_modifiers);
 	} else {
 		res = init_gbm(&modifier, 1);
@@ -506,7 +632,20 @@ const struct egl * init_egl(const struct gbm *gbm, uint64_t modifier, bool surfa
 		return NULL;
 	}
 
-	if (!gbm->surface) {
+	if (headless && !has_ext(egl_exts_dpy, "EGL_KHR_surfaceless_context")) {
+		/* a context can't be made current without surface: */
+		static const EGLint pbuffer_attribs[] = {
+			EGL_WIDTH, 1,
+			EGL_HEIGHT, 1,
+			EGL_NONE
+		};
+		egl.surface = eglCreatePbufferSurface(egl.display, egl.config,
+				pbuffer_attribs);
+		if (egl.surface == EGL_NO_SURFACE) {
+			printf("Failed to create EGL pbuffer surface\n");
+			return NULL;
+		}
+	} else if (!gbm->surface) {
 		egl.surface = EGL_NO_SURFACE;
 	} else {
 		egl.surface = eglCreateWindowSurface(egl.display, egl.config,
@@ -530,6 +669,14 @@ const struct egl * init_egl(const struct gbm *gbm, uint64_t modifier, bool surfa
 
 	get_proc_gl(GL_OES_EGL_image, glEGLImageTargetTexture2DOES);
 
+	egl.fences_supported = egl.eglCreateSyncKHR &&
+	                       egl.eglDestroySyncKHR &&
+	                       egl.eglWaitSyncKHR &&
+	                       egl.eglClientWaitSyncKHR &&
+	                       egl.eglDupNativeFenceFDANDROID;
+
+	egl.finish_required = strstr((char *) glGetString(GL_VENDOR), "NVIDIA") != NULL;
+
 	get_proc_gl(GL_AMD_performance_monitor, glGetPerfMonitorGroupsAMD);
 	get_proc_gl(GL_AMD_performance_monitor, glGetPerfMonitorCountersAMD);
 	get_proc_gl(GL_AMD_performance_monitor, glGetPerfMonitorGroupStringAMD);
@@ -542,8 +689,33 @@ const struct egl * init_egl(const struct gbm *gbm, uint64_t modifier, bool surfa
 	get_proc_gl(GL_AMD_performance_monitor, glEndPerfMonitorAMD);
 	get_proc_gl(GL_AMD_performance_monitor, glGetPerfMonitorCounterDataAMD);
 
-	if (!gbm->surface) {
-		for (unsigned i = 0; i < ARRAY_SIZE(gbm->bos); i++) {
+	get_proc_gl(GL_EXT_disjoint_timer_query, glGenQueriesEXT);
+	get_proc_gl(GL_EXT_disjoint_timer_query, glBeginQueryEXT);
+	get_proc_gl(GL_EXT_disjoint_timer_query, glEndQueryEXT);
+	get_proc_gl(GL_EXT_disjoint_timer_query, glGetQueryObjectuivEXT);
+	get_proc_gl(GL_EXT_disjoint_timer_query, glGetQueryObjectui64vEXT);
+
+	/* the program binaries are core in ES 3.0, and an extension before: */
+	int gl_major = 0;
+	sscanf((const char *) glGetString(GL_VERSION), "OpenGL ES %d", &gl_major);
+	egl.gles3 = gl_major >= 3;
+	if (egl.gles3) {
+		egl.glGetProgramBinaryOES = (void *)eglGetProcAddress("glGetProgramBinary");
+		egl.glProgramBinaryOES = (void *)eglGetProcAddress("glProgramBinary");
+	} else {
+		get_proc_gl(GL_OES_get_program_binary, glGetProgramBinaryOES);
+		get_proc_gl(GL_OES_get_program_binary, glProgramBinaryOES);
+	}
+
+	if (headless) {
+		for (unsigned i = 0; i < gbm->num_bos; i++) {
+			if (!create_texture_framebuffer(gbm->width, gbm->height, &egl.fbs[i])) {
+				printf("Failed to create framebuffer\n");
+				return NULL;
+			}
+		}
+	} else if (!gbm->surface) {
+		for (unsigned i = 0; i < gbm->num_bos; i++) {
 			if (!create_framebuffer(&egl, gbm->bos[i], &egl.fbs[i])) {
 				printf("Failed to create framebuffer\n");
 				return NULL;
@@ -554,6 +726,20 @@ const struct egl * init_egl(const struct gbm *gbm, uint64_t modifier, bool surfa
 	return &egl;
 }
 
+EGLSyncKHR create_fence(const struct egl *egl, int fd)
+{
+	EGLint attrib_list[] = {
+		EGL_SYNC_NATIVE_FENCE_FD_ANDROID, fd,
+		EGL_NONE,
+	};
+	EGLSyncKHR fence = egl->eglCreateSyncKHR(egl->display,
+			EGL_SYNC_NATIVE_FENCE_ANDROID, attrib_list);
+	assert(fence);
+	return fence;
+}
+
+struct build_times build_times;
+
 int create_program(const char *vs_src, const char *fs_src)
 {
 	GLuint vertex_shader, fragment_shader, program;
@@ -565,10 +751,14 @@ int create_program(const char *vs_src, const char *fs_src)
 		return -1;
 	}
 
+	uint64_t start = get_time_ns();
+
 	glShaderSource(vertex_shader, 1, &vs_src, NULL);
 	glCompileShader(vertex_shader);
 
+	/* the status waits for the compilation to complete: */
 	glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &ret);
+	build_times.compile_vs = get_time_ns() - start;
 	if (!ret) {
 		char *log;
 
@@ -590,10 +780,13 @@ int create_program(const char *vs_src, const char *fs_src)
 		return -1;
 	}
 
+	start = get_time_ns();
+
 	glShaderSource(fragment_shader, 1, &fs_src, NULL);
 	glCompileShader(fragment_shader);
 
 	glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &ret);
+	build_times.compile_fs = get_time_ns() - start;
 	if (!ret) {
 		char *log;
 
@@ -615,16 +808,22 @@ int create_program(const char *vs_src, const char *fs_src)
 	glAttachShader(program, vertex_shader);
 	glAttachShader(program, fragment_shader);
 
+	/* only deleted along with the program: */
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+
 	return program;
 }
 
 int link_program(unsigned program)
 {
 	GLint ret;
+	uint64_t start = get_time_ns();
 
 	glLinkProgram(program);
 
 	glGetProgramiv(program, GL_LINK_STATUS, &ret);
+	build_times.link = get_time_ns() - start;
 	if (!ret) {
 		char *log;
 
@@ -34,6 +34,9 @@
 #include <gbm.h>
 #include <drm_fourcc.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
 
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
@@ -101,7 +104,41 @@ EGLAPI EGLBoolean EGLAPIENTRY eglQueryDmaBufModifiersEXT (EGLDisplay dpy, EGLint
 #endif
 #endif /* EGL_EXT_image_dma_buf_import_modifiers */
 
+/* default and maximum number of buffers, for the surfaceless and
+ * headless cases
+ */
 #define NUM_BUFFERS 2
+#define MAX_BUFFERS 4
+
+/* default framebuffer size, for the headless case */
+#define HEADLESS_WIDTH 1920
+#define HEADLESS_HEIGHT 1080
+
+/* default frame rate, for the offline case */
+#define OFFLINE_FPS 60
+
+enum present_mode {
+	PRESENT_MODE_FIFO,       /* queue every frame, presented at vblank */
+	PRESENT_MODE_MAILBOX,    /* newest frame replaces the queued one */
+	PRESENT_MODE_IMMEDIATE,  /* present without waiting for vblank */
+};
+
+enum timing {
+	TIMING_DRAW,    /* iTime from the time the frame starts rendering */
+	TIMING_VBLANK,  /* iTime from the predicted presentation time */
+	TIMING_FIXED,   /* iTime from the frame index, at a fixed frame rate */
+};
+
+enum shard {
+	SHARD_INTERLEAVED,  /* every Nth frame to each of the N workers */
+	SHARD_CONTIGUOUS,   /* a range of frames to each worker */
+};
+
+enum stats_format {
+	STATS_NONE,
+	STATS_TEXT,
+	STATS_JSON,
+};
 
 struct options {
 	const char *device;
@@ -114,18 +151,45 @@ struct options {
 	bool surfaceless;
 	unsigned int vrefresh;
 	unsigned int frames;
+	unsigned int buffers;
+	enum present_mode present_mode;
+	unsigned int latency_target;  /* in microseconds, 0 to disable */
+	enum timing timing;
+	bool vrr;
+	enum stats_format stats;
+	bool profile;
+	const char *trace;
+	bool gpu_timing;
+	bool headless;
+	unsigned int width, height;  /* of the framebuffers, when headless */
+	unsigned int fixed_fps;      /* 0 to disable */
+	const char *capture;         /* file to stream the frames to, or - */
+	const char *output;          /* file to render the frames offline to */
+	const char *jobs;            /* numbers of worker processes, comma separated */
+	enum shard shard;
+	const char *poster;          /* WxH[@TIME] of the still to render offline */
+	const char *wall;            /* WxH+X+Y of the video wall, and of the tile */
+	const char *wall_sync;       /* N[,NAME] of the instances to sync with */
+	const char *sweep;           /* resolutions to render offscreen, comma separated */
+	bool build_times;            /* report the build times of the shader(s) only */
+	bool no_cache;               /* don't cache the binaries of the programs */
+	bool async_compile;          /* draw a placeholder while building the program */
+	bool build_info;             /* print the time spent building the program */
 };
 
 struct gbm {
 	const struct drm *drm;
 	struct gbm_device *dev;
 	struct gbm_surface *surface;
-	struct gbm_bo *bos[NUM_BUFFERS];    /* for the surfaceless case */
+	struct gbm_bo *bos[MAX_BUFFERS];    /* for the surfaceless case */
+	unsigned num_bos;
 	uint32_t format;
 	int width, height;
+	const char *device;                 /* for the headless case */
 };
 
-const struct gbm * init_gbm_device(const struct drm *drm, uint32_t format);
+const struct gbm * init_gbm_device(const struct drm *drm, uint32_t format, unsigned buffers);
+const struct gbm * init_gbm_headless(const char *device, int width, int height, unsigned buffers);
 
 struct framebuffer {
 	EGLImageKHR image;
@@ -138,7 +202,7 @@ struct egl {
 	EGLConfig config;
 	EGLContext context;
 	EGLSurface surface;
-	struct framebuffer fbs[NUM_BUFFERS];    /* for the surfaceless case */
+	struct framebuffer fbs[MAX_BUFFERS];    /* for the surfaceless and headless cases */
 
 	PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT;
 	PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
@@ -164,12 +228,36 @@ struct egl {
 	PFNGLENDPERFMONITORAMDPROC               glEndPerfMonitorAMD;
 	PFNGLGETPERFMONITORCOUNTERDATAAMDPROC    glGetPerfMonitorCounterDataAMD;
 
+	/* EXT_disjoint_timer_query */
+	PFNGLGENQUERIESEXTPROC                   glGenQueriesEXT;
+	PFNGLBEGINQUERYEXTPROC                   glBeginQueryEXT;
+	PFNGLENDQUERYEXTPROC                     glEndQueryEXT;
+	PFNGLGETQUERYOBJECTUIVEXTPROC            glGetQueryObjectuivEXT;
+	PFNGLGETQUERYOBJECTUI64VEXTPROC          glGetQueryObjectui64vEXT;
+
+	/* OES_get_program_binary, or the same entry points of ES 3.0 */
+	PFNGLGETPROGRAMBINARYOESPROC             glGetProgramBinaryOES;
+	PFNGLPROGRAMBINARYOESPROC                glProgramBinaryOES;
+
+	/* the context is ES 3.0 or later, even though created for ES 2.0: */
+	bool gles3;
+
 	bool modifiers_supported;
 
+	/* EGL_ANDROID_native_fence_sync, to pass fences to / from KMS: */
+	bool fences_supported;
+	/* Some drivers, e.g. NVIDIA, don't wait for the rendering to complete
+	 * upon page flipping, so glFinish() is required if not fencing:
+	 */
+	bool finish_required;
+
 	EGLuint64KHR *modifiers;
 	EGLint num_modifiers;
 
-	void (*draw)(uint64_t start_time, unsigned frame);
+	/* present_time is when the frame is expected to be displayed,
+	 * or 0 to use the current time:
+	 */
+	void (*draw)(uint64_t start_time, unsigned frame, uint64_t present_time);
 };
 
 static inline int __egl_check(void *ptr, const char *name)
@@ -183,23 +271,173 @@ static inline int __egl_check(void *ptr, const char *name)
 
 #define egl_check(egl, name) __egl_check((egl)->name, #name)
 
+#define VOID2U64(x) ((uint64_t)(unsigned long)(x))
+
 const struct egl * init_egl(const struct gbm *gbm, uint64_t modifier, bool surfaceless);
 
+EGLSyncKHR create_fence(const struct egl *egl, int fd);
+
+/* the time spent building the last program, in ns: */
+struct build_times {
+	uint64_t compile_vs;
+	uint64_t compile_fs;
+	uint64_t link;
+	uint64_t first_draw;  /* to complete the build, for lazy drivers */
+};
+
+extern struct build_times build_times;
+
 int create_program(const char *vs_src, const char *fs_src);
 int link_program(unsigned program);
 
-int init_shadertoy(const struct gbm *gbm, struct egl *egl, const char *shadertoy);
+void init_program_cache(const struct egl *egl);
+void disable_program_cache(void);
+void hint_program_binary(GLuint program);
+int load_program_binary(const char *vs_src, const char *fs_src);
+void save_program_binary(GLuint program);
+
+int init_shadertoy(const struct gbm *gbm, struct egl *egl, const char *shadertoy,
+                   enum timing timing, bool async_build, bool build_info);
+void set_shadertoy_tile(unsigned width, unsigned height, int x, int y);
+void finish_shadertoy(void);
+int report_build_times(const char *path);
 
-void init_perfcntrs(const struct egl *egl, const char *perfcntrs);
+void list_perfcntrs(const struct egl *egl);
+void init_perfcntrs(const struct egl *egl, const char *perfcntrs, const char *output);
 void start_perfcntrs(void);
 void end_perfcntrs(void);
 void finish_perfcntrs(void);
 void dump_perfcntrs(unsigned nframes, uint64_t elapsed_time_ns);
 
+void init_gpu_timing(const struct egl *egl);
+void start_gpu_timing(void);
+void end_gpu_timing(void);
+void dump_gpu_timing(unsigned nframes, uint64_t elapsed_time_ns);
+
+enum yuv_format {
+	YUV_I420,   /* Y, U and V planes */
+	YUV_NV12,   /* Y plane, and interleaved U and V plane */
+};
+
+const char * select_convert_kernel(const char *name);
+void init_convert(unsigned threads);
+void finish_convert(void);
+size_t yuv_frame_size(unsigned width, unsigned height);
+void convert_frame(const uint8_t *src, ptrdiff_t stride, unsigned width, unsigned height,
+                   enum yuv_format format, uint8_t *dst);
+
+struct png {
+	FILE *file;
+	unsigned width, height;
+	uint8_t *row;
+	uint32_t crc;
+	uint32_t adler_a, adler_b;
+	size_t remaining;   /* in the current chunk */
+	size_t block;       /* remaining in the current stored block */
+	bool failed;
+};
+
+bool png_begin(struct png *png, FILE *file, unsigned width, unsigned height);
+bool png_write_rows(struct png *png, const uint8_t *rgba, ptrdiff_t stride, unsigned rows);
+bool png_end(struct png *png);
+
+/* The framebuffer objects rendered into without any display, in the
+ * headless and offline cases, with as many frames in flight as there are
+ * buffers:
+ */
+struct fbo_ring {
+	EGLSyncKHR fences[MAX_BUFFERS];
+	unsigned count;
+	bool fenced;
+};
+
+void init_fbo_ring(struct fbo_ring *ring, const struct gbm *gbm, const struct egl *egl);
+unsigned acquire_fbo(struct fbo_ring *ring, const struct egl *egl, unsigned i);
+void render_fbo(struct fbo_ring *ring, const struct egl *egl, unsigned buffer,
+                uint64_t start_time, unsigned frame, uint64_t present_time);
+void finish_fbo_ring(struct fbo_ring *ring, const struct egl *egl);
+
+int init_offline(const struct options *options);
+void shard_offline(unsigned first, unsigned step, unsigned count);
+int render_parallel(const struct options *options, bool *worker);
+void worker_ready(void);
+
+int render_offline(const struct gbm *gbm, const struct egl *egl);
+
+typedef void (*capture_sink)(const uint8_t *pixels, unsigned frame);
+
+int open_capture(const char *path);
+void capture_to_sink(capture_sink sink);
+bool capture_per_frame(void);
+int start_capture(unsigned width, unsigned height, unsigned fps);
+int init_capture(unsigned width, unsigned height, unsigned fps);
+bool capture_pixels(const uint8_t *pixels, unsigned frame);
+void capture_frame(unsigned frame);
+void finish_capture(void);
+
+int init_poster(const struct options *options);
+unsigned poster_bands(size_t *size);
+void shard_poster(unsigned first, unsigned step, unsigned count);
+void poster_to_sink(capture_sink sink);
+int open_poster(const char *path);
+bool write_poster_band(const uint8_t *pixels, unsigned band);
+int finish_poster(void);
+int render_poster(const struct gbm *gbm, const struct egl *egl);
+
+int init_wall(const struct options *options, int width, int height);
+void sync_wall(unsigned *frame, uint64_t *start_time, uint64_t *present_time, time_t *date);
+
+int init_sweep(const struct options *options);
+int render_sweep(const struct gbm *gbm, const struct egl *egl);
+
+/* 1 ms wide buckets, the last one counting the longer frame times */
+#define STATS_BUCKETS 64
+
+void init_stats(enum stats_format format);
+void stats_frame(unsigned sequence, uint64_t time);
+void dump_stats(void);
+
+enum phase {
+	PHASE_DRAW,         /* egl->draw() */
+	PHASE_FINISH,       /* glFinish() */
+	PHASE_SWAP,         /* eglSwapBuffers() or glFlush() */
+	PHASE_LOCK_FRONT,   /* gbm_surface_lock_front_buffer() */
+	PHASE_FB_GET,       /* drm_fb_get_from_bo() */
+	PHASE_COMMIT,       /* drm_atomic_commit() or drmModePageFlip() */
+	PHASE_WAIT,         /* blocking on the page flip event */
+	PHASE_RENDER,       /* the onRender callbacks */
+	PHASE_GPU,          /* from the start of the frame to its fence signal */
+	PHASE_SCANOUT,      /* from the page flip to the next one */
+	PHASE_CAPTURE,      /* capture_frame() */
+	PHASE_COUNT,
+};
+
+struct span {
+	enum phase phase;
+	uint64_t start, end;
+};
+
+extern bool profiling;
+
+void init_profile(bool report, const char *trace);
+void record_phase(enum phase phase, uint64_t start, uint64_t end);
+void dump_profile(void);
+
 #define NSEC_PER_SEC (INT64_C(1000) * USEC_PER_SEC)
 #define USEC_PER_SEC (INT64_C(1000) * MSEC_PER_SEC)
 #define MSEC_PER_SEC INT64_C(1000)
 
 uint64_t get_time_ns(void);
 
+static inline uint64_t profile_begin(void)
+{
+	return profiling ? get_time_ns() : 0;
+}
+
+static inline void profile_end(enum phase phase, uint64_t start)
+{
+	if (start)
+		record_phase(phase, start, get_time_ns());
+}
+
 #endif /* _COMMON_H */
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+
+/* Microbenchmark of the RGBA to YUV 4:2:0 conversion kernels, reporting the
+ * throughput in GB/s of RGBA input, for each kernel the CPU supports, on a
+ * single thread and on all the CPUs, after checking that they output the
+ * same frames as the scalar one.
+ *
+ * Usage: convert-bench [WIDTH HEIGHT [FRAMES]]
+ */
+
+static const char *kernels[] = { "scalar", "sse4", "avx2", "neon" };
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static double bench(const uint8_t *rgba, unsigned width, unsigned height, unsigned frames,
+                    enum yuv_format format, uint8_t *yuv)
+{
+	ptrdiff_t stride = (ptrdiff_t) width * 4;
+
+	/* warm up the caches and the threads: */
+	convert_frame(rgba, stride, width, height, format, yuv);
+
+	uint64_t start = now();
+	for (unsigned i = 0; i < frames; i++)
+		convert_frame(rgba, stride, width, height, format, yuv);
+	uint64_t elapsed = now() - start;
+
+	return (double) stride * height * frames / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned width = argc > 2 ? strtoul(argv[1], NULL, 0) : 1920;
+	unsigned height = argc > 2 ? strtoul(argv[2], NULL, 0) : 1080;
+	unsigned frames = argc > 3 ? strtoul(argv[3], NULL, 0) : 200;
+	size_t size = yuv_frame_size(width, height);
+	uint8_t *rgba, *yuv, *reference[2];
+
+	if (!width || !height || !frames) {
+		printf("Usage: %s [WIDTH HEIGHT [FRAMES]]\n", argv[0]);
+		return 1;
+	}
+
+	rgba = malloc((size_t) width * height * 4);
+	yuv = malloc(size);
+	reference[YUV_I420] = malloc(size);
+	reference[YUV_NV12] = malloc(size);
+	if (!rgba || !yuv || !reference[YUV_I420] || !reference[YUV_NV12]) {
+		printf("failed to allocate the frames\n");
+		return 1;
+	}
+
+	srand(1);
+	for (size_t i = 0; i < (size_t) width * height * 4; i++)
+		rgba[i] = rand();
+
+	select_convert_kernel("scalar");
+	convert_frame(rgba, width * 4, width, height, YUV_I420, reference[YUV_I420]);
+	convert_frame(rgba, width * 4, width, height, YUV_NV12, reference[YUV_NV12]);
+
+	printf("%ux%u, %u frames, in GB/s of RGBA\n", width, height, frames);
+	printf("%-8s %-6s %10s %10s\n", "kernel", "format", "1 thread", "threaded");
+
+	for (unsigned i = 0; i < ARRAY_SIZE(kernels); i++) {
+		if (!select_convert_kernel(kernels[i]))
+			continue;
+
+		for (enum yuv_format format = YUV_I420; format <= YUV_NV12; format++) {
+			double single, threaded;
+
+			convert_frame(rgba, width * 4, width, height, format, yuv);
+			if (memcmp(yuv, reference[format], size)) {
+				printf("%-8s %-6s differs from the scalar kernel\n",
+				       kernels[i], format == YUV_I420 ? "i420" : "nv12");
+				return 1;
+			}
+
+			single = bench(rgba, width, height, frames, format, yuv);
+			init_convert(0);
+			threaded = bench(rgba, width, height, frames, format, yuv);
+			finish_convert();
+
+			printf("%-8s %-6s %10.2f %10.2f\n", kernels[i],
+			       format == YUV_I420 ? "i420" : "nv12", single, threaded);
+		}
+	}
+
+	free(reference[YUV_NV12]);
+	free(reference[YUV_I420]);
+	free(yuv);
+	free(rgba);
+
+	return 0;
+}
@@ -0,0 +1,514 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "common.h"
+
+/* Module to convert RGBA frames to YUV 4:2:0, i.e. I420 or NV12, using
+ * BT.601 limited range coefficients, in 8-bit fixed point.
+ *
+ * The frame is converted two rows at a time, which share a row of chroma,
+ * with the kernel selected at runtime, among the SSE4.1, AVX2 and NEON ones
+ * the CPU supports, and the scalar one, which the others exactly match.
+ * The pairs of rows are split into bands across worker threads, the calling
+ * thread converting the first one.
+ */
+
+#define CONVERT_MAX_THREADS 8
+
+/* converts two rows, the Y of which are written to y0 and y1, and the
+ * chroma to u and v, or interleaved to u if v is NULL:
+ */
+typedef void (*convert_rows_func)(const uint8_t *src0, const uint8_t *src1,
+		uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, unsigned width);
+
+static inline uint8_t luma(const uint8_t *p)
+{
+	return ((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16;
+}
+
+/* from the sums of the 2x2 pixels, i.e. 4 times their averages: */
+static inline uint8_t chroma_u(int r, int g, int b)
+{
+	return ((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128;
+}
+
+static inline uint8_t chroma_v(int r, int g, int b)
+{
+	return ((112 * r - 94 * g - 18 * b + 512) >> 10) + 128;
+}
+
+/* converts the pixels from x on, which the SIMD kernels leave over: */
+static void convert_rows_scalar_from(const uint8_t *src0, const uint8_t *src1,
+		uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, unsigned width, unsigned x)
+{
+	for (unsigned i = x; i < width; i++) {
+		y0[i] = luma(src0 + 4 * i);
+		y1[i] = luma(src1 + 4 * i);
+	}
+
+	for (unsigned i = x / 2; i < (width + 1) / 2; i++) {
+		const uint8_t *p0 = src0 + 8 * i, *p1 = src1 + 8 * i;
+		/* the last column is repeated for odd widths: */
+		unsigned next = 2 * i + 1 < width ? 4 : 0;
+		int r = p0[0] + p0[next + 0] + p1[0] + p1[next + 0];
+		int g = p0[1] + p0[next + 1] + p1[1] + p1[next + 1];
+		int b = p0[2] + p0[next + 2] + p1[2] + p1[next + 2];
+
+		if (v) {
+			u[i] = chroma_u(r, g, b);
+			v[i] = chroma_v(r, g, b);
+		} else {
+			u[2 * i] = chroma_u(r, g, b);
+			u[2 * i + 1] = chroma_v(r, g, b);
+		}
+	}
+}
+
+static void convert_rows_scalar(const uint8_t *src0, const uint8_t *src1,
+		uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, unsigned width)
+{
+	convert_rows_scalar_from(src0, src1, y0, y1, u, v, width, 0);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* The pixels are widened to 16-bit, two per register, so that
+ * _mm_madd_epi16() multiplies and sums the R and G, and the B, of each
+ * pixel, and _mm_hadd_epi32() sums the two, and the pixels of each pair
+ * again for the chroma.
+ */
+__attribute__((target("sse4.1")))
+static __m128i luma_sse4(__m128i px, __m128i coefs)
+{
+	__m128i lo = _mm_madd_epi16(_mm_cvtepu8_epi16(px), coefs);
+	__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, _mm_setzero_si128()), coefs);
+
+	return _mm_srli_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), _mm_set1_epi32(128)), 8);
+}
+
+__attribute__((target("sse4.1")))
+static __m128i chroma_sse4(const __m128i sums[4], __m128i coefs)
+{
+	__m128i a = _mm_hadd_epi32(_mm_madd_epi16(sums[0], coefs), _mm_madd_epi16(sums[1], coefs));
+	__m128i b = _mm_hadd_epi32(_mm_madd_epi16(sums[2], coefs), _mm_madd_epi16(sums[3], coefs));
+	__m128i c = _mm_hadd_epi32(a, b);
+
+	return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(c, _mm_set1_epi32(512)), 10),
+	                     _mm_set1_epi32(128));
+}
+
+__attribute__((target("sse4.1")))
+static void convert_rows_sse4(const uint8_t *src0, const uint8_t *src1,
+		uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, unsigned width)
+{
+	const __m128i cy = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+	const __m128i cu = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+	const __m128i cv = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i offset = _mm_set1_epi16(16);
+	unsigned x;
+
+	/* 8 pixels at a time: */
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m128i a0 = _mm_loadu_si128((const __m128i *) (src0 + 4 * x));
+		__m128i b0 = _mm_loadu_si128((const __m128i *) (src0 + 4 * x + 16));
+		__m128i a1 = _mm_loadu_si128((const __m128i *) (src1 + 4 * x));
+		__m128i b1 = _mm_loadu_si128((const __m128i *) (src1 + 4 * x + 16));
+
+		__m128i l0 = _mm_packs_epi32(luma_sse4(a0, cy), luma_sse4(b0, cy));
+		__m128i l1 = _mm_packs_epi32(luma_sse4(a1, cy), luma_sse4(b1, cy));
+		_mm_storel_epi64((__m128i *) (y0 + x), _mm_packus_epi16(_mm_add_epi16(l0, offset), zero));
+		_mm_storel_epi64((__m128i *) (y1 + x), _mm_packus_epi16(_mm_add_epi16(l1, offset), zero));
+
+		/* the vertical sums, for two pixels per register: */
+		__m128i sums[4] = {
+			_mm_add_epi16(_mm_cvtepu8_epi16(a0), _mm_cvtepu8_epi16(a1)),
+			_mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(a1, zero)),
+			_mm_add_epi16(_mm_cvtepu8_epi16(b0), _mm_cvtepu8_epi16(b1)),
+			_mm_add_epi16(_mm_unpackhi_epi8(b0, zero), _mm_unpackhi_epi8(b1, zero)),
+		};
+		__m128i uv = _mm_packs_epi32(chroma_sse4(sums, cu), chroma_sse4(sums, cv));
+
+		if (v) {
+			uv = _mm_packus_epi16(uv, zero);
+			int cu = _mm_cvtsi128_si32(uv), cv = _mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+			memcpy(u + x / 2, &cu, 4);
+			memcpy(v + x / 2, &cv, 4);
+		} else {
+			uv = _mm_unpacklo_epi16(uv, _mm_srli_si128(uv, 8));
+			_mm_storel_epi64((__m128i *) (u + x), _mm_packus_epi16(uv, zero));
+		}
+	}
+
+	convert_rows_scalar_from(src0, src1, y0, y1, u, v, width, x);
+}
+
+/* Same as SSE4.1, on 16 pixels at a time, with the 32-bit results permuted
+ * back in order, as the horizontal operations work on each 128-bit lane.
+ */
+__attribute__((target("avx2")))
+static __m256i luma_avx2(const uint8_t *src, __m256i coefs)
+{
+	const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+	__m256i m[4];
+
+	for (unsigned i = 0; i < 4; i++) {
+		__m128i px = _mm_loadu_si128((const __m128i *) (src + 16 * i));
+		m[i] = _mm256_madd_epi16(_mm256_cvtepu8_epi16(px), coefs);
+	}
+
+	/* pixels 0-7, and 8-15: */
+	__m256i a = _mm256_permutevar8x32_epi32(_mm256_hadd_epi32(m[0], m[1]), order);
+	__m256i b = _mm256_permutevar8x32_epi32(_mm256_hadd_epi32(m[2], m[3]), order);
+
+	a = _mm256_srli_epi32(_mm256_add_epi32(a, _mm256_set1_epi32(128)), 8);
+	b = _mm256_srli_epi32(_mm256_add_epi32(b, _mm256_set1_epi32(128)), 8);
+
+	__m256i l = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+	l = _mm256_packus_epi16(_mm256_add_epi16(l, _mm256_set1_epi16(16)), _mm256_setzero_si256());
+
+	return _mm256_permute4x64_epi64(l, 0x08);
+}
+
+__attribute__((target("avx2")))
+static __m256i chroma_avx2(const __m256i sums[4], __m256i coefs)
+{
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	__m256i a = _mm256_hadd_epi32(_mm256_madd_epi16(sums[0], coefs), _mm256_madd_epi16(sums[1], coefs));
+	__m256i b = _mm256_hadd_epi32(_mm256_madd_epi16(sums[2], coefs), _mm256_madd_epi16(sums[3], coefs));
+	__m256i c = _mm256_permutevar8x32_epi32(_mm256_hadd_epi32(a, b), order);
+
+	return _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(c, _mm256_set1_epi32(512)), 10),
+	                        _mm256_set1_epi32(128));
+}
+
+__attribute__((target("avx2")))
+static void convert_rows_avx2(const uint8_t *src0, const uint8_t *src1,
+		uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, unsigned width)
+{
+	const __m256i cy = _mm256_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0,
+	                                     66, 129, 25, 0, 66, 129, 25, 0);
+	const __m256i cu = _mm256_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0,
+	                                     -38, -74, 112, 0, -38, -74, 112, 0);
+	const __m256i cv = _mm256_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0,
+	                                     112, -94, -18, 0, 112, -94, -18, 0);
+	const __m256i zero = _mm256_setzero_si256();
+	unsigned x;
+
+	/* 16 pixels at a time: */
+	for (x = 0; x + 16 <= width; x += 16) {
+		_mm_storeu_si128((__m128i *) (y0 + x), _mm256_castsi256_si128(luma_avx2(src0 + 4 * x, cy)));
+		_mm_storeu_si128((__m128i *) (y1 + x), _mm256_castsi256_si128(luma_avx2(src1 + 4 * x, cy)));
+
+		/* the vertical sums, for four pixels per register: */
+		__m256i sums[4];
+		for (unsigned i = 0; i < 4; i++) {
+			__m128i p0 = _mm_loadu_si128((const __m128i *) (src0 + 4 * x + 16 * i));
+			__m128i p1 = _mm_loadu_si128((const __m128i *) (src1 + 4 * x + 16 * i));
+			sums[i] = _mm256_add_epi16(_mm256_cvtepu8_epi16(p0), _mm256_cvtepu8_epi16(p1));
+		}
+		__m256i uv = _mm256_packs_epi32(chroma_avx2(sums, cu), chroma_avx2(sums, cv));
+
+		if (v) {
+			uv = _mm256_packus_epi16(_mm256_permute4x64_epi64(uv, 0xd8), zero);
+			_mm_storel_epi64((__m128i *) (u + x / 2), _mm256_castsi256_si128(uv));
+			_mm_storel_epi64((__m128i *) (v + x / 2), _mm256_extracti128_si256(uv, 1));
+		} else {
+			uv = _mm256_unpacklo_epi16(uv, _mm256_srli_si256(uv, 8));
+			uv = _mm256_permute4x64_epi64(_mm256_packus_epi16(uv, zero), 0x08);
+			_mm_storeu_si128((__m128i *) (u + x), _mm256_castsi256_si128(uv));
+		}
+	}
+
+	convert_rows_scalar_from(src0, src1, y0, y1, u, v, width, x);
+}
+
+#elif defined(__ARM_NEON)
+
+static int16x8_t chroma_neon(int16x8_t r, int16x8_t g, int16x8_t b, int16_t cr, int16_t cg, int16_t cb)
+{
+	int32x4_t lo = vmull_n_s16(vget_low_s16(r), cr);
+	int32x4_t hi = vmull_n_s16(vget_high_s16(r), cr);
+
+	lo = vmlal_n_s16(lo, vget_low_s16(g), cg);
+	hi = vmlal_n_s16(hi, vget_high_s16(g), cg);
+	lo = vmlal_n_s16(lo, vget_low_s16(b), cb);
+	hi = vmlal_n_s16(hi, vget_high_s16(b), cb);
+
+	lo = vshrq_n_s32(vaddq_s32(lo, vdupq_n_s32(512)), 10);
+	hi = vshrq_n_s32(vaddq_s32(hi, vdupq_n_s32(512)), 10);
+
+	return vaddq_s16(vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)), vdupq_n_s16(128));
+}
+
+static uint8x16_t luma_neon(uint8x16x4_t px)
+{
+	/* the sum of the products fits in 16-bit, unsigned: */
+	uint16x8_t lo = vmull_u8(vget_low_u8(px.val[0]), vdup_n_u8(66));
+	uint16x8_t hi = vmull_u8(vget_high_u8(px.val[0]), vdup_n_u8(66));
+
+	lo = vmlal_u8(lo, vget_low_u8(px.val[1]), vdup_n_u8(129));
+	hi = vmlal_u8(hi, vget_high_u8(px.val[1]), vdup_n_u8(129));
+	lo = vmlal_u8(lo, vget_low_u8(px.val[2]), vdup_n_u8(25));
+	hi = vmlal_u8(hi, vget_high_u8(px.val[2]), vdup_n_u8(25));
+
+	uint8x16_t l = vcombine_u8(vshrn_n_u16(vaddq_u16(lo, vdupq_n_u16(128)), 8),
+	                           vshrn_n_u16(vaddq_u16(hi, vdupq_n_u16(128)), 8));
+
+	return vaddq_u8(l, vdupq_n_u8(16));
+}
+
+static void convert_rows_neon(const uint8_t *src0, const uint8_t *src1,
+		uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, unsigned width)
+{
+	unsigned x;
+
+	/* 16 pixels at a time, deinterleaved on load: */
+	for (x = 0; x + 16 <= width; x += 16) {
+		uint8x16x4_t p0 = vld4q_u8(src0 + 4 * x);
+		uint8x16x4_t p1 = vld4q_u8(src1 + 4 * x);
+
+		vst1q_u8(y0 + x, luma_neon(p0));
+		vst1q_u8(y1 + x, luma_neon(p1));
+
+		/* the sums of the 2x2 pixels: */
+		int16x8_t r = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[0]), p1.val[0]));
+		int16x8_t g = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]));
+		int16x8_t b = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[2]), p1.val[2]));
+
+		uint8x8_t cu = vqmovun_s16(chroma_neon(r, g, b, -38, -74, 112));
+		uint8x8_t cv = vqmovun_s16(chroma_neon(r, g, b, 112, -94, -18));
+
+		if (v) {
+			vst1_u8(u + x / 2, cu);
+			vst1_u8(v + x / 2, cv);
+		} else {
+			vst2_u8(u + x, (uint8x8x2_t) {{ cu, cv }});
+		}
+	}
+
+	convert_rows_scalar_from(src0, src1, y0, y1, u, v, width, x);
+}
+
+#endif
+
+static const struct {
+	const char *name;
+	convert_rows_func func;
+} kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+	{ "avx2", convert_rows_avx2 },
+	{ "sse4", convert_rows_sse4 },
+#elif defined(__ARM_NEON)
+	{ "neon", convert_rows_neon },
+#endif
+	{ "scalar", convert_rows_scalar },
+};
+
+static bool kernel_supported(const char *name)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	if (!strcmp(name, "avx2"))
+		return __builtin_cpu_supports("avx2");
+	if (!strcmp(name, "sse4"))
+		return __builtin_cpu_supports("sse4.1");
+#endif
+	return true;
+}
+
+struct convert_job {
+	const uint8_t *src;
+	ptrdiff_t stride;
+	unsigned width, height;
+	enum yuv_format format;
+	uint8_t *dst;
+};
+
+static struct {
+	const char *name;
+	convert_rows_func func;
+
+	pthread_t threads[CONVERT_MAX_THREADS];
+	unsigned num_threads;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	unsigned generation;  /* of the job to run */
+	unsigned pending;     /* threads still running it */
+	bool quit;
+
+	struct convert_job job;
+} convert = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.start = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+const char * select_convert_kernel(const char *name)
+{
+	for (unsigned i = 0; i < ARRAY_SIZE(kernels); i++) {
+		if (name && strcmp(name, kernels[i].name))
+			continue;
+		if (!kernel_supported(kernels[i].name))
+			continue;
+
+		convert.name = kernels[i].name;
+		convert.func = kernels[i].func;
+		return convert.name;
+	}
+
+	return NULL;
+}
+
+size_t yuv_frame_size(unsigned width, unsigned height)
+{
+	return (size_t) width * height + 2 * (size_t) ((width + 1) / 2) * ((height + 1) / 2);
+}
+
+/* Converts the pairs of rows of the band: */
+static void convert_band(const struct convert_job *job, unsigned band, unsigned bands)
+{
+	unsigned cw = (job->width + 1) / 2, ch = (job->height + 1) / 2;
+	uint8_t *y = job->dst, *u = y + (size_t) job->width * job->height;
+	uint8_t *v = job->format == YUV_I420 ? u + (size_t) cw * ch : NULL;
+	size_t uv_stride = job->format == YUV_I420 ? cw : 2 * cw;
+
+	for (unsigned i = ch * band / bands; i < ch * (band + 1) / bands; i++) {
+		/* the last row is repeated for odd heights: */
+		unsigned r0 = 2 * i, r1 = MIN2(2 * i + 1, job->height - 1);
+
+		convert.func(job->src + r0 * job->stride, job->src + r1 * job->stride,
+		             y + (size_t) r0 * job->width, y + (size_t) r1 * job->width,
+		             u + i * uv_stride, v ? v + i * uv_stride : NULL, job->width);
+	}
+}
+
+static void *convert_thread(void *arg)
+{
+	unsigned band = (uintptr_t) arg;
+	unsigned generation = 0;
+
+	pthread_mutex_lock(&convert.lock);
+	for (;;) {
+		while (convert.generation == generation && !convert.quit)
+			pthread_cond_wait(&convert.start, &convert.lock);
+		if (convert.quit)
+			break;
+		generation = convert.generation;
+
+		pthread_mutex_unlock(&convert.lock);
+		convert_band(&convert.job, band, convert.num_threads + 1);
+		pthread_mutex_lock(&convert.lock);
+
+		if (--convert.pending == 0)
+			pthread_cond_signal(&convert.done);
+	}
+	pthread_mutex_unlock(&convert.lock);
+
+	return NULL;
+}
+
+/* Starts the given number of threads to convert the frames with, 0 to use
+ * as many as there are CPUs, including the calling one:
+ */
+void init_convert(unsigned threads)
+{
+	if (!convert.func)
+		select_convert_kernel(NULL);
+
+	if (!threads)
+		threads = MAX2(sysconf(_SC_NPROCESSORS_ONLN), 1);
+	threads = MIN2(threads, CONVERT_MAX_THREADS);
+
+	for (unsigned i = 1; i < threads; i++) {
+		if (pthread_create(&convert.threads[convert.num_threads], NULL,
+		                   convert_thread, (void *) (uintptr_t) i)) {
+			printf("failed to start the conversion thread\n");
+			break;
+		}
+		convert.num_threads++;
+	}
+}
+
+void finish_convert(void)
+{
+	pthread_mutex_lock(&convert.lock);
+	convert.quit = true;
+	pthread_cond_broadcast(&convert.start);
+	pthread_mutex_unlock(&convert.lock);
+
+	for (unsigned i = 0; i < convert.num_threads; i++)
+		pthread_join(convert.threads[i], NULL);
+
+	convert.num_threads = 0;
+	convert.generation = 0;
+	convert.quit = false;
+}
+
+/* Converts the RGBA frame, the stride of which is negative for bottom-up
+ * rows, into the planes of the YUV frame, laid out contiguously:
+ */
+void convert_frame(const uint8_t *src, ptrdiff_t stride, unsigned width, unsigned height,
+                   enum yuv_format format, uint8_t *dst)
+{
+	if (!convert.func)
+		select_convert_kernel(NULL);
+
+	convert.job = (struct convert_job) {
+		.src = src,
+		.stride = stride,
+		.width = width,
+		.height = height,
+		.format = format,
+		.dst = dst,
+	};
+
+	if (!convert.num_threads) {
+		convert_band(&convert.job, 0, 1);
+		return;
+	}
+
+	pthread_mutex_lock(&convert.lock);
+	convert.pending = convert.num_threads;
+	convert.generation++;
+	pthread_cond_broadcast(&convert.start);
+	pthread_mutex_unlock(&convert.lock);
+
+	convert_band(&convert.job, 0, convert.num_threads + 1);
+
+	pthread_mutex_lock(&convert.lock);
+	while (convert.pending)
+		pthread_cond_wait(&convert.done, &convert.lock);
+	pthread_mutex_unlock(&convert.lock);
+}
@@ -23,10 +23,14 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#define _GNU_SOURCE
+
+#include <assert.h>
 #include <errno.h>
 #include <poll.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "common.h"
@@ -56,6 +60,21 @@ static int add_connector_property(drmModeAtomicReq *req, uint32_t obj_id,
 	return drmModeAtomicAddProperty(req, obj_id, prop_id, value);
 }
 
+static int get_connector_property(const char *name, uint64_t *value)
+{
+	struct connector *obj = drm.connector;
+	unsigned int i;
+
+	for (i = 0; i < obj->props->count_props; i++) {
+		if (strcmp(obj->props_info[i]->name, name) == 0) {
+			*value = obj->props->prop_values[i];
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
 static int add_crtc_property(drmModeAtomicReq *req, uint32_t obj_id,
                              const char *name, uint64_t value)
 {
@@ -97,24 +116,27 @@ static int drm_atomic_commit(uint32_t fb_id, uint32_t flags)
 	drmModeAtomicReq *req;
 	uint32_t plane_id = drm.plane->plane->plane_id;
 	uint32_t blob_id;
-	int ret;
+	int ret = -1;
 
 	req = drmModeAtomicAlloc();
 
 	if (flags & DRM_MODE_ATOMIC_ALLOW_MODESET) {
 		if (add_connector_property(req, drm.connector_id, "CRTC_ID",
 		                           drm.crtc_id) < 0)
-			return -1;
+			goto out;
 
 		if (drmModeCreatePropertyBlob(drm.fd, drm.mode, sizeof(*drm.mode),
 		                              &blob_id) != 0)
-			return -1;
+			goto out;
 
 		if (add_crtc_property(req, drm.crtc_id, "MODE_ID", blob_id) < 0)
-			return -1;
+			goto out;
 
 		if (add_crtc_property(req, drm.crtc_id, "ACTIVE", 1) < 0)
-			return -1;
+			goto out;
+
+		if (drm.vrr && add_crtc_property(req, drm.crtc_id, "VRR_ENABLED", 1) < 0)
+			goto out;
 	}
 
 	add_plane_property(req, plane_id, "FB_ID", fb_id);
@@ -128,49 +150,240 @@ static int drm_atomic_commit(uint32_t fb_id, uint32_t flags)
 	add_plane_property(req, plane_id, "CRTC_W", drm.mode->hdisplay);
 	add_plane_property(req, plane_id, "CRTC_H", drm.mode->vdisplay);
 
+	if (drm.kms_in_fence_fd != -1) {
+		add_crtc_property(req, drm.crtc_id, "OUT_FENCE_PTR",
+		                  VOID2U64(&drm.kms_out_fence_fd));
+		add_plane_property(req, plane_id, "IN_FENCE_FD", drm.kms_in_fence_fd);
+	}
+
 	ret = drmModeAtomicCommit(drm.fd, req, flags, NULL);
 
+out:
+	/* the in-fence is ours to close, whether the commit succeeded or not: */
+	if (drm.kms_in_fence_fd != -1) {
+		close(drm.kms_in_fence_fd);
+		drm.kms_in_fence_fd = -1;
+	}
 	drmModeAtomicFree(req);
 
 	return ret;
 }
 
+static struct gbm_bo *scanout_bo;  /* buffer on screen */
+static struct gbm_bo *pending_bo;  /* buffer committed, until the page flip completes */
+static int pending_fence_fd = -1;  /* rendering fence of the pending buffer */
+static uint64_t pending_start_time;
+static int waiting_for_flip;
+
 static void page_flip_handler(int fd, unsigned int frame,
                               unsigned int sec, unsigned int usec, void *data)
 {
 	/* suppress 'unused parameter' warnings */
-	(void) fd, (void) frame, (void) sec, (void) usec, (void) data;
+	(void) fd, (void) data;
 	//	printf("page flip event occurred: %12.6f\n", sec + (usec / 1000000.0));
+
+	schedule_page_flip(&drm, frame, sec, usec);
+
+	waiting_for_flip = 0;
+}
+
+/* Dispatch the DRM events, and check for user input, waiting up to the
+ * given timeout, or until an event is received if negative. Returns 1 if
+ * the user interrupted.
+ */
+static int handle_events(int64_t timeout)
+{
+	drmEventContext evctx = {
+			.version = 4,
+			.page_flip_handler = page_flip_handler
+	};
+	struct pollfd fdset[] = {
+			{
+					.fd = STDIN_FILENO,
+					.events = POLLIN,
+			},
+			{
+					.fd = drm.fd,
+					.events = POLLIN,
+			},
+	};
+	int ret;
+
+	struct timespec ts = {
+			.tv_sec = timeout / NSEC_PER_SEC,
+			.tv_nsec = timeout % NSEC_PER_SEC,
+	};
+
+	ret = ppoll(fdset, ARRAY_SIZE(fdset), timeout < 0 ? NULL : &ts, NULL);
+	if (ret < 0) {
+		if (errno == EINTR)
+			return 0;
+		printf("poll err: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (fdset[0].revents & POLLIN) {
+		printf("user interrupted!\n");
+		return 1;
+	}
+
+	if (fdset[1].revents & POLLIN) {
+		ret = drmHandleEvent(drm.fd, &evctx);
+		if (ret) {
+			printf("failed to handle page flip event\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Commit the next queued frame, unless a page flip is still pending */
+static int present(const struct gbm *gbm, const struct egl *egl, uint32_t *flags)
+{
+	struct present_frame frame;
+	int ret;
+
+	if (pending_bo && !waiting_for_flip) {
+		/* the page flip has completed, release the previous buffer,
+		 * unless it's already been released upon commit:
+		 */
+		if (scanout_bo)
+			release_buffer(&drm, gbm, egl, scanout_bo, -1);
+		scanout_bo = pending_bo;
+		pending_bo = NULL;
+
+		/* KMS has waited for the rendering to complete, measure it: */
+		if (pending_fence_fd != -1) {
+			uint64_t rendered_time = get_fence_time_ns(pending_fence_fd);
+
+			schedule_rendered(&drm, pending_start_time, rendered_time);
+			if (profiling && rendered_time > pending_start_time)
+				record_phase(PHASE_GPU, pending_start_time, rendered_time);
+			close(pending_fence_fd);
+			pending_fence_fd = -1;
+		}
+	}
+
+	if (waiting_for_flip || !dequeue_frame(&drm, &frame))
+		return 0;
+
+	drm.kms_in_fence_fd = frame.fence_fd;
+	if (frame.fence_fd != -1 && (drm.schedule.margin || drm.timing == TIMING_VBLANK ||
+	                             profiling)) {
+		pending_fence_fd = dup(frame.fence_fd);
+		pending_start_time = frame.start_time;
+	}
+
+	/*
+	 * Here you could also update drm plane layers if you want
+	 * hw composition
+	 */
+	uint64_t commit_start = profile_begin();
+	ret = drm_atomic_commit(frame.fb_id, *flags);
+	profile_end(PHASE_COMMIT, commit_start);
+	if (ret) {
+		printf("failed to commit: %s\n", strerror(errno));
+		if (pending_fence_fd != -1) {
+			close(pending_fence_fd);
+			pending_fence_fd = -1;
+		}
+		return -1;
+	}
+
+	waiting_for_flip = 1;
+	pending_bo = frame.bo;
+
+	if (drm.kms_out_fence_fd != -1) {
+		/* the buffer on screen can be rendered into again as soon as
+		 * this commit completes, i.e., once the out-fence signals:
+		 */
+		if (scanout_bo) {
+			release_buffer(&drm, gbm, egl, scanout_bo, drm.kms_out_fence_fd);
+			scanout_bo = NULL;
+		} else {
+			close(drm.kms_out_fence_fd);
+		}
+		drm.kms_out_fence_fd = -1;
+	}
+
+	/* Allow a modeset change for the first commit only. */
+	*flags &= ~(DRM_MODE_ATOMIC_ALLOW_MODESET);
+
+	return 0;
 }
 
 static int atomic_run(const struct gbm *gbm, const struct egl *egl)
 {
-	struct gbm_bo *bo = NULL;
+	struct gbm_bo *next_bo;
 	struct drm_fb *fb;
 	uint32_t i = 0;
 	uint64_t start_time, report_time, cur_time;
-	int ret;
+	int ret = 0;
+
+	/* Use explicit fencing when available, so that rendering the next
+	 * frame overlaps with the scanout of the current one, instead of
+	 * blocking until the GPU is idle and the page flip has completed:
+	 */
+	bool fenced = egl->fences_supported;
 
-	uint32_t flags = DRM_MODE_ATOMIC_NONBLOCK;
-	if (drm.async_page_flip) {
+	uint32_t flags = DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT;
+	if (drm.present_mode == PRESENT_MODE_IMMEDIATE) {
 		flags |= DRM_MODE_PAGE_FLIP_ASYNC;
-	} else {
-		flags |= DRM_MODE_PAGE_FLIP_EVENT;
 	}
 
-	drmEventContext evctx = {
-			.version = 4,
-			.page_flip_handler = page_flip_handler
-	};
-
 	/* Allow a modeset change for the first commit only. */
 	flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
 
+	init_buffers(&drm, gbm);
+
 	start_time = report_time = get_time_ns();
 
 	while (drm.frames == 0 || i < drm.frames) {
-		unsigned frame = i;
-		struct gbm_bo *next_bo;
+		int fence_fd = -1;
+		int buffer = -1;
+
+		if (stop_requested())
+			break;
+
+		/* Present the queued frames as page flips complete, and block
+		 * until there is a buffer to render the next frame into. In
+		 * mailbox and immediate modes, rendering only blocks when all
+		 * the buffers are on screen, pending or queued.
+		 */
+		bool block = false;
+		do {
+			uint64_t wait_start = block ? profile_begin() : 0;
+			ret = handle_events(block ? -1 : 0);
+			profile_end(PHASE_WAIT, wait_start);
+			if (ret < 0)
+				return -1;
+			if (ret)
+				goto out;  /* user interrupted */
+
+			ret = present(gbm, egl, &flags);
+			if (ret)
+				return -1;
+
+			block = !can_render(&drm, gbm);
+			assert(!block || waiting_for_flip);
+		} while (block);
+
+		/* Delay the rendering, so that it completes just in time for
+		 * the vblank, to minimize the latency:
+		 */
+		uint64_t draw_time = schedule_draw(&drm, waiting_for_flip);
+		while ((cur_time = get_time_ns()) < draw_time) {
+			ret = handle_events(draw_time - cur_time);
+			if (ret < 0)
+				return -1;
+			if (ret)
+				goto out;  /* user interrupted */
+
+			ret = present(gbm, egl, &flags);
+			if (ret)
+				return -1;
+		}
 
 		/* Start fps measuring on second frame, to remove the time spent
 		 * compiling shader, etc, from the fps:
@@ -179,38 +392,97 @@ static int atomic_run(const struct gbm *gbm, const struct egl *egl)
 			start_time = report_time = get_time_ns();
 		}
 
+		uint64_t frame_start_time = get_time_ns();
+
 		if (!gbm->surface) {
-			glBindFramebuffer(GL_FRAMEBUFFER, egl->fbs[frame % NUM_BUFFERS].fb);
+			buffer = acquire_buffer(&drm, egl);
+			glBindFramebuffer(GL_FRAMEBUFFER, egl->fbs[buffer].fb);
 		}
 
-		egl->draw(start_time, i++);
+		uint64_t present_time = 0;
+		if (drm.timing == TIMING_VBLANK) {
+			present_time = schedule_present(&drm, waiting_for_flip);
+		} else if (drm.timing == TIMING_FIXED) {
+			present_time = fixed_present_time(&drm, start_time, i);
+		}
 
-		/* Block until all the buffered GL operations are completed.
-		 * This is required on NVIDIA GPUs, for which the DRM drivers
-		 * do not wait for the rendering to complete, upon executing
-		 * page flipping operations.
-		 */
-		glFinish();
+		uint64_t phase_start = profile_begin();
+		egl->draw(start_time, i++, present_time);
+		profile_end(PHASE_DRAW, phase_start);
+
+		phase_start = profile_begin();
+		capture_frame(i - 1);
+		profile_end(PHASE_CAPTURE, phase_start);
+
+		EGLSyncKHR gpu_fence = NULL;   /* out-fence from gpu, in-fence to kms */
+		if (fenced) {
+			/* insert fence to be signaled in cmdstream.. this fence will
+			 * be signaled when gpu rendering done
+			 */
+			gpu_fence = create_fence(egl, EGL_NO_NATIVE_FENCE_FD_ANDROID);
+		} else if (egl->finish_required) {
+			/* Block until all the buffered GL operations are completed.
+			 * This is required on NVIDIA GPUs, for which the DRM drivers
+			 * do not wait for the rendering to complete, upon executing
+			 * page flipping operations.
+			 */
+			phase_start = profile_begin();
+			glFinish();
+			profile_end(PHASE_FINISH, phase_start);
+		}
 
+		phase_start = profile_begin();
 		if (gbm->surface) {
 			eglSwapBuffers(egl->display, egl->surface);
+		} else {
+			glFlush();
+		}
+		profile_end(PHASE_SWAP, phase_start);
+
+		if (gpu_fence) {
+			/* after swapbuffers / flush, gpu_fence should be flushed,
+			 * so safe to get fd:
+			 */
+			fence_fd = egl->eglDupNativeFenceFDANDROID(egl->display, gpu_fence);
+			egl->eglDestroySyncKHR(egl->display, gpu_fence);
+			assert(fence_fd != -1);
+		} else {
+			/* the rendering duration is measured upon page flip
+			 * completion when fencing, otherwise upon finishing:
+			 */
+			schedule_finished(&drm, frame_start_time);
 		}
 
 		if (gbm->surface) {
+			phase_start = profile_begin();
 			next_bo = gbm_surface_lock_front_buffer(gbm->surface);
+			profile_end(PHASE_LOCK_FRONT, phase_start);
 		} else {
-			next_bo = gbm->bos[frame % NUM_BUFFERS];
+			next_bo = gbm->bos[buffer];
 		}
 		if (!next_bo) {
 			printf("Failed to lock front buffer\n");
 			return -1;
 		}
+		phase_start = profile_begin();
 		fb = drm_fb_get_from_bo(next_bo);
+		profile_end(PHASE_FB_GET, phase_start);
 		if (!fb) {
 			printf("Failed to get a new framebuffer BO\n");
 			return -1;
 		}
 
+		queue_frame(&drm, gbm, egl, &(struct present_frame) {
+				.bo = next_bo,
+				.fb_id = fb->fb_id,
+				.fence_fd = fence_fd,
+				.start_time = frame_start_time,
+		});
+
+		ret = present(gbm, egl, &flags);
+		if (ret)
+			return -1;
+
 		cur_time = get_time_ns();
 		if (cur_time > (report_time + 2 * NSEC_PER_SEC)) {
 			double elapsed_time = cur_time - start_time;
@@ -218,61 +490,29 @@ static int atomic_run(const struct gbm *gbm, const struct egl *egl)
 			unsigned frames = i - 1;  /* first frame ignored */
 			printf("Rendered %u frames in %f sec (%f fps)\n",
 			       frames, secs, (double) frames / secs);
+			dump_gpu_timing(frames, elapsed_time);
+			dump_stats();
 			report_time = cur_time;
 		}
-
-		/* Check for user input: */
-		struct pollfd fdset[] = {
-				{
-						.fd = STDIN_FILENO,
-						.events = POLLIN,
-				}
-		};
-		ret = poll(fdset, ARRAY_SIZE(fdset), 0);
-		if (ret > 0) {
-			printf("user interrupted!\n");
-			return 0;
-		}
-
-		/*
-		 * Here you could also update drm plane layers if you want
-		 * hw composition
-		 */
-		ret = drm_atomic_commit(fb->fb_id, flags);
-		if (ret) {
-			printf("failed to commit: %s\n", strerror(errno));
-			return -1;
-		}
-
-		if (!drm.async_page_flip) {
-			ret = drmHandleEvent(drm.fd, &evctx);
-			if (ret) {
-				printf("failed to wait for page flip completion\n");
-				return -1;
-			}
-		}
-
-		/* release last buffer to render on again: */
-		if (bo && gbm->surface)
-			gbm_surface_release_buffer(gbm->surface, bo);
-		bo = next_bo;
-
-		/* Allow a modeset change for the first commit only. */
-		flags &= ~(DRM_MODE_ATOMIC_ALLOW_MODESET);
 	}
 
+out:
 	finish_perfcntrs();
+	finish_capture();
 
 	cur_time = get_time_ns();
 	double elapsed_time = cur_time - start_time;
 	double secs = elapsed_time / (double) NSEC_PER_SEC;
-	unsigned frames = i - 1;  /* first frame ignored */
+	unsigned frames = i > 1 ? i - 1 : 0;  /* first frame ignored */
 	printf("Rendered %u frames in %f sec (%f fps)\n",
 	       frames, secs, (double) frames / secs);
 
 	dump_perfcntrs(frames, elapsed_time);
+	dump_gpu_timing(frames, elapsed_time);
+	dump_stats();
+	dump_profile();
 
-	return ret;
+	return 0;
 }
 
 const struct drm * init_drm_atomic(int fd, const struct options *options)
@@ -289,6 +529,19 @@ const struct drm * init_drm_atomic(int fd, const struct options *options)
 	if (ret)
 		return NULL;
 
+	drm.kms_in_fence_fd = -1;
+	drm.kms_out_fence_fd = -1;
+
+	if (options->vrr) {
+		uint64_t vrr_capable = 0;
+		get_connector_property("vrr_capable", &vrr_capable);
+		if (vrr_capable) {
+			drm.vrr = true;
+		} else {
+			printf("Connector isn't VRR capable, using fixed refresh rate\n");
+		}
+	}
+
 	drm.run = atomic_run;
 
 	return &drm;
@@ -21,12 +21,16 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <assert.h>
+#include <signal.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/sync_file.h>
 
 #include "common.h"
 #include "drm-common.h"
@@ -121,6 +125,315 @@ struct drm_fb * drm_fb_get_from_bo(struct gbm_bo *bo)
 	return fb;
 }
 
+void init_buffers(struct drm *drm, const struct gbm *gbm)
+{
+	struct buffer_ring *ring = &drm->ring;
+
+	assert(gbm->num_bos <= MAX_BUFFERS);
+
+	for (unsigned i = 0; i < gbm->num_bos; i++) {
+		ring->buffers[i] = i;
+		ring->fences[i] = -1;
+	}
+	ring->head = 0;
+	ring->count = gbm->num_bos;
+
+	drm->queue.head = 0;
+	drm->queue.count = 0;
+}
+
+/* Pop the least recently released buffer, and make the GPU wait until it's
+ * no longer scanned out before rendering into it. Returns the buffer index,
+ * or -1 if all the buffers are in use.
+ */
+int acquire_buffer(struct drm *drm, const struct egl *egl)
+{
+	struct buffer_ring *ring = &drm->ring;
+
+	if (!ring->count)
+		return -1;
+
+	unsigned slot = ring->head;
+	unsigned buffer = ring->buffers[slot];
+	int fence_fd = ring->fences[slot];
+
+	ring->head = (ring->head + 1) % MAX_BUFFERS;
+	ring->count--;
+
+	if (fence_fd != -1) {
+		/* the EGL sync object takes the fd ownership */
+		EGLSyncKHR fence = create_fence(egl, fence_fd);
+		egl->eglWaitSyncKHR(egl->display, fence, 0);
+		egl->eglDestroySyncKHR(egl->display, fence);
+	}
+
+	return buffer;
+}
+
+/* Give back a buffer once it's been replaced on screen, or will be once
+ * the given fence fd signals, which ownership is taken.
+ */
+void release_buffer(struct drm *drm, const struct gbm *gbm, const struct egl *egl,
+                    struct gbm_bo *bo, int fence_fd)
+{
+	struct buffer_ring *ring = &drm->ring;
+
+	if (gbm->surface) {
+		/* We don't know which buffer the GBM surface renders into
+		 * next, so stall the rendering until the fence signals:
+		 */
+		if (fence_fd != -1) {
+			EGLSyncKHR fence = create_fence(egl, fence_fd);
+			egl->eglWaitSyncKHR(egl->display, fence, 0);
+			egl->eglDestroySyncKHR(egl->display, fence);
+		}
+		gbm_surface_release_buffer(gbm->surface, bo);
+		return;
+	}
+
+	for (unsigned i = 0; i < gbm->num_bos; i++) {
+		if (gbm->bos[i] != bo)
+			continue;
+
+		unsigned slot = (ring->head + ring->count) % MAX_BUFFERS;
+		assert(ring->count < gbm->num_bos);
+		ring->buffers[slot] = i;
+		ring->fences[slot] = fence_fd;
+		ring->count++;
+		return;
+	}
+
+	assert(!"unknown buffer");
+}
+
+/* Whether a buffer is available to render the next frame into */
+bool can_render(const struct drm *drm, const struct gbm *gbm)
+{
+	if (drm->queue.count == ARRAY_SIZE(drm->queue.frames))
+		return false;
+
+	if (gbm->surface)
+		return gbm_surface_has_free_buffers(gbm->surface);
+
+	return drm->ring.count > 0;
+}
+
+/* Queue a rendered frame to be committed. Unless in FIFO mode, the frames
+ * that haven't been committed yet are dropped, so that the newest frame
+ * gets presented at the next opportunity.
+ */
+void queue_frame(struct drm *drm, const struct gbm *gbm, const struct egl *egl,
+                 const struct present_frame *frame)
+{
+	struct present_queue *queue = &drm->queue;
+	struct present_frame dropped;
+
+	if (drm->present_mode != PRESENT_MODE_FIFO) {
+		while (dequeue_frame(drm, &dropped)) {
+			if (dropped.fence_fd != -1)
+				close(dropped.fence_fd);
+			release_buffer(drm, gbm, egl, dropped.bo, -1);
+		}
+	}
+
+	assert(queue->count < ARRAY_SIZE(queue->frames));
+	queue->frames[(queue->head + queue->count) % ARRAY_SIZE(queue->frames)] = *frame;
+	queue->count++;
+}
+
+bool dequeue_frame(struct drm *drm, struct present_frame *frame)
+{
+	struct present_queue *queue = &drm->queue;
+
+	if (!queue->count)
+		return false;
+
+	*frame = queue->frames[queue->head];
+	queue->head = (queue->head + 1) % ARRAY_SIZE(queue->frames);
+	queue->count--;
+
+	return true;
+}
+
+/* Returns the time at which the given sync file fence has signaled,
+ * or 0 if it hasn't or that cannot be queried.
+ */
+uint64_t get_fence_time_ns(int fence_fd)
+{
+	struct sync_fence_info fence_info = {0};
+	struct sync_file_info file_info = {
+		.num_fences = 1,
+		.sync_fence_info = VOID2U64(&fence_info),
+	};
+
+	if (ioctl(fence_fd, SYNC_IOC_FILE_INFO, &file_info) < 0)
+		return 0;
+
+	if (file_info.status != 1)
+		return 0;
+
+	return fence_info.timestamp_ns;
+}
+
+static volatile sig_atomic_t stopping;
+
+/* Request the run loops to stop after the current frame, going through
+ * their teardown, e.g. from another thread or a signal handler:
+ */
+void request_stop(void)
+{
+	stopping = 1;
+}
+
+bool stop_requested(void)
+{
+	return stopping;
+}
+
+void schedule_page_flip(struct drm *drm, unsigned int sequence,
+                        unsigned int sec, unsigned int usec)
+{
+	uint64_t last_vblank_time = drm->schedule.vblank_time;
+
+	drm->schedule.sequence = sequence;
+	drm->schedule.vblank_time = sec * NSEC_PER_SEC + usec * (NSEC_PER_SEC / USEC_PER_SEC);
+
+	if (profiling && last_vblank_time && drm->schedule.vblank_time > last_vblank_time)
+		record_phase(PHASE_SCANOUT, last_vblank_time, drm->schedule.vblank_time);
+
+	stats_frame(sequence, drm->schedule.vblank_time);
+}
+
+void schedule_rendered(struct drm *drm, uint64_t start_time, uint64_t end_time)
+{
+	struct frame_schedule *schedule = &drm->schedule;
+
+	if (end_time < start_time)
+		return;
+
+	schedule->render_times[schedule->render_idx] = end_time - start_time;
+	schedule->render_idx = (schedule->render_idx + 1) % SCHEDULE_HISTORY;
+}
+
+/* Without a fence to measure the rendering duration upon page flip
+ * completion, wait for the rendering to complete, when the scheduling of
+ * the next frames, or their predicted presentation time, depends on it,
+ * as the CPU time of the submission only tells how long it took to queue
+ * the commands:
+ */
+void schedule_finished(struct drm *drm, uint64_t start_time)
+{
+	if (drm->schedule.margin || drm->timing == TIMING_VBLANK) {
+		uint64_t phase_start = profile_begin();
+		glFinish();
+		profile_end(PHASE_FINISH, phase_start);
+	}
+
+	schedule_rendered(drm, start_time, get_time_ns());
+}
+
+static uint64_t max_render_time(const struct frame_schedule *schedule)
+{
+	uint64_t render_time = 0;
+
+	/* Be conservative, and plan for the slowest of the recent frames: */
+	for (unsigned i = 0; i < SCHEDULE_HISTORY; i++)
+		render_time = MAX2(render_time, schedule->render_times[i]);
+
+	return render_time;
+}
+
+/* Predict the first vblank after the given time, assuming a pending flip
+ * completes on the next one, in which case the frame can only be presented
+ * on the following one, and so on for the frames queued before it:
+ */
+static uint64_t next_vblank(const struct drm *drm, uint64_t time, bool flip_pending)
+{
+	const struct frame_schedule *schedule = &drm->schedule;
+	uint64_t now = get_time_ns();
+	uint64_t vblank = schedule->vblank_time;
+
+	if (drm->vrr) {
+		/* The display refreshes as soon as the frame is presented,
+		 * no sooner than the period of the mode, i.e., its maximum
+		 * refresh rate, after the previous one:
+		 */
+		vblank += schedule->period;
+		if (flip_pending)
+			vblank = MAX2(vblank, now) + schedule->period;
+		if (drm->present_mode == PRESENT_MODE_FIFO)
+			vblank += drm->queue.count * schedule->period;
+
+		return MAX2(vblank, time);
+	}
+
+	if (now > vblank)
+		vblank += ((now - vblank) / schedule->period + 1) * schedule->period;
+	if (flip_pending)
+		vblank += schedule->period;
+	if (drm->present_mode == PRESENT_MODE_FIFO)
+		vblank += drm->queue.count * schedule->period;
+
+	while (vblank < time)
+		vblank += schedule->period;
+
+	return vblank;
+}
+
+/* Returns the time at which the next frame should start rendering, so that
+ * it's ready the safety margin before the vblank it can be presented at,
+ * or 0 if it should start right away.
+ */
+uint64_t schedule_draw(const struct drm *drm, bool flip_pending)
+{
+	const struct frame_schedule *schedule = &drm->schedule;
+	uint64_t render_time, vblank;
+
+	if (!schedule->margin || !schedule->vblank_time || !schedule->period)
+		return 0;
+
+	/* With VRR, frames are presented as soon as they are rendered */
+	if (drm->vrr)
+		return 0;
+
+	render_time = max_render_time(schedule);
+	vblank = next_vblank(drm, get_time_ns() + render_time + schedule->margin,
+	                     flip_pending);
+
+	return vblank - render_time - schedule->margin;
+}
+
+/* Returns the time at which the frame that starts rendering now is expected
+ * to be displayed, or 0 if it cannot be predicted.
+ */
+uint64_t schedule_present(struct drm *drm, bool flip_pending)
+{
+	struct frame_schedule *schedule = &drm->schedule;
+
+	if (!schedule->period)
+		return 0;
+
+	if (!schedule->vblank_time) {
+		/* no page flip yet, start from the current vblank */
+		uint64_t sequence, ns;
+		if (drmCrtcGetSequence(drm->fd, drm->crtc_id, &sequence, &ns))
+			return 0;
+		schedule->sequence = sequence;
+		schedule->vblank_time = ns;
+	}
+
+	return next_vblank(drm, get_time_ns() + max_render_time(schedule) + schedule->margin,
+	                   flip_pending);
+}
+
+/* Returns the time the frame is displayed at, as if the frames were
+ * presented at the fixed frame rate, however fast they are rendered:
+ */
+uint64_t fixed_present_time(const struct drm *drm, uint64_t start_time, unsigned frame)
+{
+	return start_time + (uint64_t) frame * NSEC_PER_SEC / drm->fixed_fps;
+}
+
 static int32_t find_crtc_for_encoder(const drmModeRes *resources,
                                      const drmModeEncoder *encoder)
 {
@@ -411,7 +724,9 @@ int init_drm(struct drm *drm, const int fd, const struct options *options)
 	int i, area;
 
 	drm->fd = fd;
-	drm->async_page_flip = options->async_page_flip;
+	drm->present_mode = options->present_mode;
+	if (options->async_page_flip)
+		drm->present_mode = PRESENT_MODE_IMMEDIATE;
 	drm->frames = options->frames;
 
 	get_resources(drm->fd, &resources);
@@ -469,6 +784,18 @@ int init_drm(struct drm *drm, const int fd, const struct options *options)
 		return -1;
 	}
 
+	drm->timing = options->fixed_fps ? TIMING_FIXED : options->timing;
+	drm->fixed_fps = options->fixed_fps;
+	drm->schedule.margin = options->latency_target * (NSEC_PER_SEC / USEC_PER_SEC);
+	if (drm->mode->clock) {
+		uint64_t period = (uint64_t) drm->mode->htotal * drm->mode->vtotal * USEC_PER_SEC / drm->mode->clock;
+		if (drm->mode->flags & DRM_MODE_FLAG_INTERLACE)
+			period /= 2;
+		if (drm->mode->flags & DRM_MODE_FLAG_DBLSCAN)
+			period *= 2;
+		drm->schedule.period = period;
+	}
+
 	/* find encoder: */
 	for (i = 0; i < resources->count_encoders; i++) {
 		encoder = drmModeGetEncoder(drm->fd, resources->encoders[i]);
@@ -49,6 +49,44 @@ struct connector {
 	drmModePropertyRes **props_info;
 };
 
+/* Free-list of the surfaceless mode buffers, in the order they are
+ * released, i.e., replaced on screen. Each buffer comes with an optional
+ * fence fd, signaled once it is no longer scanned out.
+ */
+struct buffer_ring {
+	unsigned buffers[MAX_BUFFERS];
+	int fences[MAX_BUFFERS];
+	unsigned head, count;
+};
+
+/* A rendered frame, waiting to be committed */
+struct present_frame {
+	struct gbm_bo *bo;
+	uint32_t fb_id;
+	int fence_fd;    /* signaled once rendering completes, or -1 */
+	uint64_t start_time;
+};
+
+/* Frames ready to be presented, in rendering order */
+struct present_queue {
+	struct present_frame frames[MAX_BUFFERS];
+	unsigned head, count;
+};
+
+/* Just-in-time frame scheduling, from the page flip timestamps, so that
+ * rendering starts as late as possible while completing before the vblank.
+ */
+#define SCHEDULE_HISTORY 16
+
+struct frame_schedule {
+	uint64_t margin;          /* safety margin before the vblank, 0 if disabled */
+	uint64_t period;          /* refresh period */
+	uint64_t vblank_time;     /* timestamp of the last page flip */
+	unsigned int sequence;    /* vblank sequence of the last page flip */
+	uint64_t render_times[SCHEDULE_HISTORY];
+	unsigned render_idx;
+};
+
 struct drm {
 	int fd;
 
@@ -61,7 +99,23 @@ struct drm {
 	uint32_t crtc_id;
 	uint32_t connector_id;
 
-	bool async_page_flip;
+	enum present_mode present_mode;
+
+	/* variable refresh rate, atomic only: */
+	bool vrr;
+
+	/* atomic explicit fencing, -1 if unused: */
+	int kms_in_fence_fd;
+	int kms_out_fence_fd;
+
+	/* free buffers, for the surfaceless case: */
+	struct buffer_ring ring;
+	/* frames rendered but not committed yet: */
+	struct present_queue queue;
+
+	struct frame_schedule schedule;
+	enum timing timing;
+	unsigned int fixed_fps;
 
 	/* number of frames to run for: */
 	unsigned int frames;
@@ -76,6 +130,24 @@ struct drm_fb {
 
 struct drm_fb * drm_fb_get_from_bo(struct gbm_bo *bo);
 
+void init_buffers(struct drm *drm, const struct gbm *gbm);
+int acquire_buffer(struct drm *drm, const struct egl *egl);
+void release_buffer(struct drm *drm, const struct gbm *gbm, const struct egl *egl,
+                    struct gbm_bo *bo, int fence_fd);
+bool can_render(const struct drm *drm, const struct gbm *gbm);
+void queue_frame(struct drm *drm, const struct gbm *gbm, const struct egl *egl,
+                 const struct present_frame *frame);
+bool dequeue_frame(struct drm *drm, struct present_frame *frame);
+
+uint64_t get_fence_time_ns(int fence_fd);
+void schedule_page_flip(struct drm *drm, unsigned int sequence,
+                        unsigned int sec, unsigned int usec);
+void schedule_rendered(struct drm *drm, uint64_t start_time, uint64_t end_time);
+void schedule_finished(struct drm *drm, uint64_t start_time);
+uint64_t schedule_draw(const struct drm *drm, bool flip_pending);
+uint64_t schedule_present(struct drm *drm, bool flip_pending);
+uint64_t fixed_present_time(const struct drm *drm, uint64_t start_time, unsigned frame);
+
 int find_drm_device();
 
 int find_plane_prop(const struct drm *drm, const char *name, unsigned int *prop_idx);
@@ -88,4 +160,9 @@ const struct drm *init_drm_legacy(int fd, const struct options *options);
 
 const struct drm *init_drm_atomic(int fd, const struct options *options);
 
+const struct drm *init_headless(const struct options *options);
+
+void request_stop(void);
+bool stop_requested(void);
+
 #endif /* _DRM_COMMON_H */
@@ -32,36 +32,110 @@
 
 static struct drm drm;
 
+static struct gbm_bo *scanout_bo;  /* buffer on screen */
+static struct gbm_bo *pending_bo;  /* buffer flipped, until the page flip completes */
+static int waiting_for_flip;
+
 static void page_flip_handler(int fd, unsigned int frame,
                               unsigned int sec, unsigned int usec, void *data)
 {
 	/* suppress 'unused parameter' warnings */
-	(void) fd, (void) frame, (void) sec, (void) usec;
+	(void) fd, (void) data;
+
+	schedule_page_flip(&drm, frame, sec, usec);
 
-	int *waiting_for_flip = data;
-	*waiting_for_flip = 0;
+	waiting_for_flip = 0;
 }
 
-static int legacy_run(const struct gbm *gbm, const struct egl *egl)
+/* Dispatch the DRM events, and check for user input, waiting up to the
+ * given timeout, or until an event is received if negative. Returns 1 if
+ * the user interrupted.
+ */
+static int handle_events(int64_t timeout)
 {
 	fd_set fds;
 	drmEventContext evctx = {
 			.version = 2,
 			.page_flip_handler = page_flip_handler,
 	};
-	struct gbm_bo *bo;
+	struct timeval tv = {
+			.tv_sec = timeout / NSEC_PER_SEC,
+			.tv_usec = (timeout % NSEC_PER_SEC) / (NSEC_PER_SEC / USEC_PER_SEC),
+	};
+	int ret;
+
+	FD_ZERO(&fds);
+	FD_SET(0, &fds);
+	FD_SET(drm.fd, &fds);
+
+	ret = select(drm.fd + 1, &fds, NULL, NULL, timeout < 0 ? NULL : &tv);
+	if (ret < 0) {
+		if (errno == EINTR)
+			return 0;
+		printf("select err: %s\n", strerror(errno));
+		return ret;
+	} else if (ret == 0) {
+		return 0;
+	} else if (FD_ISSET(0, &fds)) {
+		printf("user interrupted!\n");
+		return 1;
+	}
+	drmHandleEvent(drm.fd, &evctx);
+
+	return 0;
+}
+
+/* Flip to the next queued frame, unless a page flip is still pending */
+static int present(const struct gbm *gbm, const struct egl *egl, uint32_t flags)
+{
+	struct present_frame frame;
+	int ret;
+
+	if (pending_bo && !waiting_for_flip) {
+		/* the page flip has completed, release the previous buffer: */
+		release_buffer(&drm, gbm, egl, scanout_bo, -1);
+		scanout_bo = pending_bo;
+		pending_bo = NULL;
+	}
+
+	if (waiting_for_flip || !dequeue_frame(&drm, &frame))
+		return 0;
+
+	/*
+	 * Here you could also update drm plane layers if you want
+	 * hw composition
+	 */
+	uint64_t commit_start = profile_begin();
+	ret = drmModePageFlip(drm.fd, drm.crtc_id, frame.fb_id, flags, NULL);
+	profile_end(PHASE_COMMIT, commit_start);
+	if (ret) {
+		printf("failed to queue page flip: %s\n", strerror(errno));
+		return -1;
+	}
+
+	waiting_for_flip = 1;
+	pending_bo = frame.bo;
+
+	return 0;
+}
+
+static int legacy_run(const struct gbm *gbm, const struct egl *egl)
+{
+	struct gbm_bo *next_bo;
 	struct drm_fb *fb;
 	uint32_t i = 0;
 	uint64_t start_time, report_time, cur_time;
 	int ret;
 
+	init_buffers(&drm, gbm);
+
 	if (gbm->surface) {
 		eglSwapBuffers(egl->display, egl->surface);
-		bo = gbm_surface_lock_front_buffer(gbm->surface);
+		scanout_bo = gbm_surface_lock_front_buffer(gbm->surface);
 	} else {
-		bo = gbm->bos[0];
+		scanout_bo = gbm->bos[acquire_buffer(&drm, egl)];
 	}
-	fb = drm_fb_get_from_bo(bo);
+	fb = drm_fb_get_from_bo(scanout_bo);
 	if (!fb) {
 		fprintf(stderr, "Failed to get a new framebuffer BO\n");
 		return -1;
@@ -75,20 +149,55 @@ static int legacy_run(const struct gbm *gbm, const struct egl *egl)
 		return ret;
 	}
 
-	uint32_t flags;
+	uint32_t flags = DRM_MODE_PAGE_FLIP_EVENT;
 
-	if (drm.async_page_flip) {
-		flags = DRM_MODE_PAGE_FLIP_ASYNC;
-	} else {
-		flags = DRM_MODE_PAGE_FLIP_EVENT;
+	if (drm.present_mode == PRESENT_MODE_IMMEDIATE) {
+		flags |= DRM_MODE_PAGE_FLIP_ASYNC;
 	}
 
 	start_time = report_time = get_time_ns();
 
 	while (drm.frames == 0 || i < drm.frames) {
-		unsigned frame = i;
-		struct gbm_bo *next_bo;
-		int waiting_for_flip = 1;
+		int buffer = -1;
+
+		if (stop_requested())
+			break;
+
+		/* Present the queued frames as page flips complete, and block
+		 * until there is a buffer to render the next frame into:
+		 */
+		bool block = false;
+		do {
+			uint64_t wait_start = block ? profile_begin() : 0;
+			ret = handle_events(block ? -1 : 0);
+			profile_end(PHASE_WAIT, wait_start);
+			if (ret < 0)
+				return -1;
+			if (ret)
+				goto out;  /* user interrupted */
+
+			ret = present(gbm, egl, flags);
+			if (ret)
+				return -1;
+
+			block = !can_render(&drm, gbm);
+		} while (block);
+
+		/* Delay the rendering, so that it completes just in time for
+		 * the vblank, to minimize the latency:
+		 */
+		uint64_t draw_time = schedule_draw(&drm, waiting_for_flip);
+		while ((cur_time = get_time_ns()) < draw_time) {
+			ret = handle_events(draw_time - cur_time);
+			if (ret < 0)
+				return -1;
+			if (ret)
+				goto out;  /* user interrupted */
+
+			ret = present(gbm, egl, flags);
+			if (ret)
+				return -1;
+		}
 
 		/* Start fps measuring on second frame, to remove the time spent
 		 * compiling shader, etc, from the fps:
@@ -97,63 +206,74 @@ static int legacy_run(const struct gbm *gbm, const struct egl *egl)
 			start_time = report_time = get_time_ns();
 		}
 
+		uint64_t frame_start_time = get_time_ns();
+
 		if (!gbm->surface) {
-			glBindFramebuffer(GL_FRAMEBUFFER, egl->fbs[frame % NUM_BUFFERS].fb);
+			buffer = acquire_buffer(&drm, egl);
+			glBindFramebuffer(GL_FRAMEBUFFER, egl->fbs[buffer].fb);
+		}
+
+		uint64_t present_time = 0;
+		if (drm.timing == TIMING_VBLANK) {
+			present_time = schedule_present(&drm, waiting_for_flip);
+		} else if (drm.timing == TIMING_FIXED) {
+			present_time = fixed_present_time(&drm, start_time, i);
 		}
 
-		egl->draw(start_time, i++);
+		uint64_t phase_start = profile_begin();
+		egl->draw(start_time, i++, present_time);
+		profile_end(PHASE_DRAW, phase_start);
+
+		phase_start = profile_begin();
+		capture_frame(i - 1);
+		profile_end(PHASE_CAPTURE, phase_start);
 
 		/* Block until all the buffered GL operations are completed.
 		 * This is required on NVIDIA GPUs, for which the DRM drivers
 		 * do not wait for the rendering to complete, upon executing
 		 * page flipping operations, such as drmModePageFlip().
+		 * Other drivers implicitly synchronize the page flip with the
+		 * rendering of the buffer, so flushing is enough.
 		 */
-		glFinish();
+		if (egl->finish_required) {
+			phase_start = profile_begin();
+			glFinish();
+			profile_end(PHASE_FINISH, phase_start);
+		}
 
 		if (gbm->surface) {
+			phase_start = profile_begin();
 			eglSwapBuffers(egl->display, egl->surface);
+			profile_end(PHASE_SWAP, phase_start);
+			phase_start = profile_begin();
 			next_bo = gbm_surface_lock_front_buffer(gbm->surface);
+			profile_end(PHASE_LOCK_FRONT, phase_start);
 		} else {
-			next_bo = gbm->bos[frame % NUM_BUFFERS];
+			phase_start = profile_begin();
+			glFlush();
+			profile_end(PHASE_SWAP, phase_start);
+			next_bo = gbm->bos[buffer];
 		}
+		schedule_finished(&drm, frame_start_time);
+
+		phase_start = profile_begin();
 		fb = drm_fb_get_from_bo(next_bo);
+		profile_end(PHASE_FB_GET, phase_start);
 		if (!fb) {
 			fprintf(stderr, "Failed to get a new framebuffer BO\n");
 			return -1;
 		}
 
-		/*
-		 * Here you could also update drm plane layers if you want
-		 * hw composition
-		 */
+		queue_frame(&drm, gbm, egl, &(struct present_frame) {
+				.bo = next_bo,
+				.fb_id = fb->fb_id,
+				.fence_fd = -1,
+				.start_time = frame_start_time,
+		});
 
-		ret = drmModePageFlip(drm.fd, drm.crtc_id, fb->fb_id,
-		                      flags, &waiting_for_flip);
-		if (ret) {
-			printf("failed to queue page flip: %s\n", strerror(errno));
+		ret = present(gbm, egl, flags);
+		if (ret)
 			return -1;
-		}
-
-		if (!drm.async_page_flip) {
-			while (waiting_for_flip) {
-				FD_ZERO(&fds);
-				FD_SET(0, &fds);
-				FD_SET(drm.fd, &fds);
-
-				ret = select(drm.fd + 1, &fds, NULL, NULL, NULL);
-				if (ret < 0) {
-					printf("select err: %s\n", strerror(errno));
-					return ret;
-				} else if (ret == 0) {
-					printf("select timeout!\n");
-					return -1;
-				} else if (FD_ISSET(0, &fds)) {
-					printf("user interrupted!\n");
-					return 0;
-				}
-				drmHandleEvent(drm.fd, &evctx);
-			}
-		}
 
 		cur_time = get_time_ns();
 		if (cur_time > (report_time + 2 * NSEC_PER_SEC)) {
@@ -162,26 +282,27 @@ static int legacy_run(const struct gbm *gbm, const struct egl *egl)
 			unsigned frames = i - 1;  /* first frame ignored */
 			printf("Rendered %u frames in %f sec (%f fps)\n",
 			       frames, secs, (double) frames / secs);
+			dump_gpu_timing(frames, elapsed_time);
+			dump_stats();
 			report_time = cur_time;
 		}
-
-		/* release last buffer to render on again: */
-		if (gbm->surface) {
-			gbm_surface_release_buffer(gbm->surface, bo);
-		}
-		bo = next_bo;
 	}
 
+out:
 	finish_perfcntrs();
+	finish_capture();
 
 	cur_time = get_time_ns();
 	double elapsed_time = cur_time - start_time;
 	double secs = elapsed_time / (double) NSEC_PER_SEC;
-	unsigned frames = i - 1;  /* first frame ignored */
+	unsigned frames = i > 1 ? i - 1 : 0;  /* first frame ignored */
 	printf("Rendered %u frames in %f sec (%f fps)\n",
 	       frames, secs, (double) frames / secs);
 
 	dump_perfcntrs(frames, elapsed_time);
+	dump_gpu_timing(frames, elapsed_time);
+	dump_stats();
+	dump_profile();
 
 	return 0;
 }
@@ -200,6 +321,10 @@ const struct drm * init_drm_legacy(int fd, const struct options *options)
 	if (ret)
 		return NULL;
 
+	if (options->vrr) {
+		printf("VRR requires atomic mode setting, using fixed refresh rate\n");
+	}
+
 	drm.run = legacy_run;
 
 	return &drm;
@@ -29,6 +29,7 @@
 #include <getopt.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <signal.h>
 
 #include "glsl.h"
 #include "drm-common.h"
@@ -38,47 +39,153 @@
 static const struct egl *egl;
 static const struct gbm *gbm;
 static const struct drm *drm;
+static bool offline;
+static bool poster;
+static bool sweep;
+static bool builds;
 
-static const char *shortopts = "aAC:D:f:hm:n:p:v:x";
+static const char *shortopts = "aAb:Bc:C:D:Ef:F:ghH::ij:l:Lm:n:No:O:p:P:rR:s::S:t:T:v:Vw:W:xz:";
 
 static const struct option longopts[] = {
 		{"async",        no_argument,       0, 'a'},
 		{"atomic",       no_argument,       0, 'A'},
+		{"buffers",      required_argument, 0, 'b'},
+		{"build-times",  no_argument,       0, 'B'},
+		{"capture",      required_argument, 0, 'c'},
 		{"connector",    required_argument, 0, 'C'},
 		{"device",       required_argument, 0, 'D'},
 		{"format",       required_argument, 0, 'f'},
+		{"fixed-fps",    required_argument, 0, 'F'},
+		{"gpu-timing",   no_argument,       0, 'g'},
 		{"help",         no_argument,       0, 'h'},
+		{"headless",     optional_argument, 0, 'H'},
+		{"build-info",   no_argument,       0, 'i'},
+		{"jobs",         required_argument, 0, 'j'},
+		{"latency-target", required_argument, 0, 'l'},
 		{"modifier",     required_argument, 0, 'm'},
 		{"frames",       required_argument, 0, 'n'},
+		{"async-compile", no_argument,      0, 'E'},
+		{"no-cache",     no_argument,       0, 'N'},
+		{"perfcntr-output", required_argument, 0, 'o'},
+		{"output",       required_argument, 0, 'O'},
 		{"perfcntr",     required_argument, 0, 'p'},
+		{"perfcntr-list", no_argument,      0, 'L'},
+		{"present-mode", required_argument, 0, 'P'},
+		{"profile",      no_argument,       0, 'r'},
+		{"shard",        required_argument, 0, 'S'},
+		{"stats",        optional_argument, 0, 's'},
+		{"timing",       required_argument, 0, 't'},
+		{"trace",        required_argument, 0, 'T'},
 		{"vmode",        required_argument, 0, 'v'},
+		{"vrr",          no_argument,       0, 'V'},
+		{"sweep",        required_argument, 0, 'R'},
+		{"wall",         required_argument, 0, 'w'},
+		{"wall-sync",    required_argument, 0, 'W'},
 		{"surfaceless",  no_argument,       0, 'x'},
+		{"poster",       required_argument, 0, 'z'},
 		{0,              0,                 0, 0}
 };
 
 static void usage(const char *name) {
-	printf("Usage: %s [-aACDfmnpvx] <shader_file>\n"
+	printf("Usage: %s [-aAbBcCDEfFghHjlLmnNoOpPrRsStTvVwWxz] <shader_file>\n"
+	       "       %s -L\n"
 	       "\n"
 	       "options:\n"
-	       "    -a, --async              use async page flipping\n"
+	       "    -a, --async              use async page flipping, same as\n"
+	       "                             --present-mode=immediate\n"
 	       "    -A, --atomic             use atomic mode setting and fencing\n"
+	       "    -b, --buffers=N          number of buffers in surfaceless and headless\n"
+	       "                             modes (2-4, default: 2)\n"
+	       "    -B, --build-times        report the time spent compiling the vertex and\n"
+	       "                             fragment shaders, linking the program and first\n"
+	       "                             drawing with it, for the shader, or for each\n"
+	       "                             shader of the directory given instead, offscreen\n"
+	       "    -c, --capture=PATH       stream the frames to the given file, or to the\n"
+	       "                             standard output if -, as Y4M if it ends with\n"
+	       "                             .y4m or is -, raw I420 if it ends with .yuv\n"
+	       "                             or .i420, raw NV12 if it ends with .nv12, PNG\n"
+	       "                             files named after the path formatted with the\n"
+	       "                             frame index if it ends with .png, e.g.\n"
+	       "                             frame%%04d.png, and raw RGBA otherwise\n"
 	       "    -C, --connector=ID       use the connector with the provided ID (see drm_info)\n"
-	       "    -D, --device=DEVICE      use the given device\n"
+	       "    -D, --device=DEVICE      use the given device, also headless and to list\n"
+	       "                             the performance counters\n"
+	       "    -E, --async-compile      build the program in the background, drawing a\n"
+	       "                             placeholder from the first frame on, until it's\n"
+	       "                             built (with display only)\n"
 	       "    -f, --format=FOURCC      framebuffer format\n"
+	       "    -F, --fixed-fps=N        compute iTime, iTimeDelta and iDate from the\n"
+	       "                             frame index, as if rendering at N fps, so\n"
+	       "                             that the same frames are rendered on every run\n"
+	       "    -g, --gpu-timing         measure the GPU time spent drawing the frames\n"
+	       "                             using the EXT_disjoint_timer_query extension\n"
 	       "    -h, --help               print usage\n"
+	       "    -H, --headless[=WxH]     render into framebuffer objects of the given\n"
+	       "                             size (default: 1920x1080), without display\n"
+	       "    -i, --build-info         print the time spent building the program and\n"
+	       "                             first drawing with it, on startup\n"
+	       "    -j, --jobs=N[,N...]      render offline with N worker processes, or\n"
+	       "                             with each of the given numbers of workers in\n"
+	       "                             turn, to measure how the throughput scales,\n"
+	       "                             only writing the last run out (requires -O)\n"
+	       "    -l, --latency-target=MS  delay rendering so that it completes the given\n"
+	       "                             safety margin before the vblank (in ms)\n"
+	       "    -L, --perfcntr-list      list the performance counters available with\n"
+	       "                             the AMD_performance_monitor extension, and exit\n"
 	       "    -m, --modifier=MODIFIER  hardcode the selected modifier\n"
 	       "    -n, --frames=N           run for the given number of frames and exit\n"
+	       "    -N, --no-cache           don't cache the binaries of the programs, under\n"
+	       "                             $XDG_CACHE_HOME/glsl, to load them on next runs\n"
+	       "    -o, --perfcntr-output=FILE\n"
+	       "                             write the performance counters of each frame\n"
+	       "                             to the given file, as CSV, or JSON if it ends\n"
+	       "                             with .json\n"
+	       "    -O, --output=PATH        render the frames offline to the given file,\n"
+	       "                             in any of the capture formats, as fast as\n"
+	       "                             possible, at the fixed frame rate (default:\n"
+	       "                             60 fps), without display (requires -n)\n"
 	       "    -p, --perfcntr=LIST      sample specified performance counters using\n"
 	       "                             the AMD_performance_monitor extension (comma\n"
 	       "                             separated list)\n"
+	       "    -P, --present-mode=MODE  fifo (default), mailbox or immediate\n"
+	       "    -r, --profile            measure the CPU time spent in each phase of\n"
+	       "                             the frames, and report it upon exit\n"
+	       "    -R, --sweep=WxH[,...]    render the frames offscreen at each of the\n"
+	       "                             given resolutions, and write the frame times and\n"
+	       "                             fill rates to the standard output, as CSV\n"
+	       "    -s, --stats[=FORMAT]     report the frame time percentiles, missed\n"
+	       "                             deadlines and histogram, as text (default)\n"
+	       "                             or json\n"
+	       "    -S, --shard=SHARD        give every Nth frame to each of the N workers\n"
+	       "                             (interleaved, default), or a range of frames\n"
+	       "                             (contiguous)\n"
+	       "    -t, --timing=TIMING      compute iTime from the time the frame starts\n"
+	       "                             rendering (draw, default), or from the time\n"
+	       "                             it's presented at (vblank)\n"
+	       "    -T, --trace=FILE         write a Chrome trace of the frames upon exit,\n"
+	       "                             that can be opened with Perfetto\n"
 	       "    -v, --vmode=VMODE        specify the video mode in the format\n"
 	       "                             <mode>[-<vrefresh>]\n"
-	       "    -x, --surfaceless        use surfaceless mode, instead of GBM surface\n",
-	       name);
+	       "    -V, --vrr                enable variable refresh rate, if supported\n"
+	       "                             by the connector (requires atomic), and\n"
+	       "                             present frames as soon as they are rendered\n"
+	       "    -w, --wall=WxH+X+Y       render the tile at the given offset from the top\n"
+	       "                             left corner of a video wall of the given size,\n"
+	       "                             of which each instance renders a tile\n"
+	       "    -W, --wall-sync=N[,NAME] sync the N instances of the wall through the\n"
+	       "                             given shared memory (default: /glsl-wall), for\n"
+	       "                             them to render the same frames at the same time\n"
+	       "    -x, --surfaceless        use surfaceless mode, instead of GBM surface\n"
+	       "    -z, --poster=WxH[@TIME]  render a still of the given size offline, at\n"
+	       "                             the given time (default: 0), in tiles of the\n"
+	       "                             size of the framebuffer (see -H), to a PNG file\n"
+	       "                             if the output ends with .png, raw RGBA\n"
+	       "                             otherwise (requires -O)",
+	       name, name);
 }
 
-int init(const char *shadertoy, const struct options *options) {
-	int ret;
+static const struct drm *init_display(const struct options *options) {
+	const struct drm *drm;
 	int fd;
 
 	if (options->device) {
@@ -100,7 +207,7 @@ int init(const char *shadertoy, const struct options *options) {
 			xcb_randr_query_version_reply_t *rqv_r = xcb_randr_query_version_reply(connection, rqv_c, NULL);
 			if (!rqv_r || rqv_r->minor_version < 6) {
 				printf("No new-enough RandR version: %d\n", rqv_r->minor_version);
-				return -1;
+				return NULL;
 			}
 			free(rqv_r);
 
@@ -112,7 +219,7 @@ int init(const char *shadertoy, const struct options *options) {
 	}
 	if (fd < 0) {
 		printf("could not open DRM device\n");
-		return -1;
+		return NULL;
 	}
 
 	if (options->atomic_drm_mode) {
@@ -122,6 +229,81 @@ int init(const char *shadertoy, const struct options *options) {
 	}
 	if (!drm) {
 		printf("failed to initialize %s DRM\n", options->atomic_drm_mode ? "atomic" : "legacy");
+		return NULL;
+	}
+
+	return drm;
+}
+
+static void interrupted(int sig) {
+	(void) sig;
+	request_stop();
+}
+
+/* The counters only depend on the GPU, so they are listed from a headless
+ * context, without any shader:
+ */
+static int list_counters(const struct options *options) {
+	gbm = init_gbm_headless(options->device, HEADLESS_WIDTH, HEADLESS_HEIGHT, NUM_BUFFERS);
+	if (!gbm) {
+		printf("failed to initialize GBM\n");
+		return -1;
+	}
+
+	egl = init_egl(gbm, DRM_FORMAT_MOD_INVALID, options->surfaceless);
+	if (!egl) {
+		printf("failed to initialize EGL\n");
+		return -1;
+	}
+
+	list_perfcntrs(egl);
+
+	return 0;
+}
+
+int init(const char *shadertoy, const struct options *options) {
+	int ret;
+
+	offline = options->output != NULL;
+	poster = options->poster != NULL;
+	if (poster) {
+		ret = init_poster(options);
+		if (ret < 0) {
+			return -1;
+		}
+		ret = open_poster(options->output);
+		if (ret < 0) {
+			return -1;
+		}
+	} else if (offline) {
+		ret = init_offline(options);
+		if (ret < 0) {
+			return -1;
+		}
+	}
+
+	builds = options->build_times;
+	sweep = options->sweep != NULL;
+	if (sweep) {
+		ret = init_sweep(options);
+		if (ret < 0) {
+			return -1;
+		}
+	}
+
+	if (options->capture || (offline && !poster)) {
+		ret = open_capture(offline ? options->output : options->capture);
+		if (ret < 0) {
+			return -1;
+		}
+	}
+
+	if (options->headless || offline || sweep || builds) {
+		drm = init_headless(options);
+	} else {
+		drm = init_display(options);
+	}
+	if (!drm) {
 		return -1;
 	}
 
@@ -133,7 +315,18 @@ int init(const char *shadertoy, const struct options *options) {
 	if (options->modifier) {
 		modifier = options->modifier;
 	}
-	gbm = init_gbm_device(drm, format);
+	unsigned buffers = NUM_BUFFERS;
+	if (options->buffers) {
+		buffers = MIN2(MAX2(options->buffers, 2), MAX_BUFFERS);
+	}
+	if (options->headless || offline || sweep || builds) {
+		gbm = init_gbm_headless(options->device,
+		                        options->width ? options->width : HEADLESS_WIDTH,
+		                        options->height ? options->height : HEADLESS_HEIGHT,
+		                        buffers);
+	} else {
+		gbm = init_gbm_device(drm, format, buffers);
+	}
 	if (!gbm) {
 		printf("failed to initialize GBM\n");
 		return -1;
@@ -145,11 +338,53 @@ int init(const char *shadertoy, const struct options *options) {
 		return -1;
 	}
 
-	ret = init_shadertoy(gbm, egl, shadertoy);
+	if (options->no_cache) {
+		disable_program_cache();
+	}
+	init_program_cache(egl);
+
+	/* the shaders are built for the report only: */
+	if (builds) {
+		return 0;
+	}
+
+	/* the frames rendered offline are all rendered with the program: */
+	ret = init_shadertoy(gbm, egl, shadertoy,
+	                     options->fixed_fps || offline || sweep ? TIMING_FIXED : options->timing,
+	                     options->async_compile && !offline && !sweep, options->build_info);
 	if (ret < 0) {
 		return -1;
 	}
 
+	if (options->wall) {
+		ret = init_wall(options, gbm->width, gbm->height);
+		if (ret < 0) {
+			return -1;
+		}
+	}
+
+	init_stats(options->stats);
+	init_profile(options->profile, options->trace);
+
+	if (options->gpu_timing) {
+		init_gpu_timing(egl);
+	}
+
+	if (options->capture || (offline && !poster)) {
+		unsigned fps = 60;
+		if (offline && !options->fixed_fps) {
+			fps = OFFLINE_FPS;
+		} else if (options->fixed_fps) {
+			fps = options->fixed_fps;
+		} else if (drm->mode) {
+			fps = drm->mode->vrefresh;
+		}
+		ret = init_capture(gbm->width, gbm->height, fps);
+		if (ret < 0) {
+			return -1;
+		}
+	}
+
 	glClearColor((GLfloat) 0.5, (GLfloat) 0.5, (GLfloat) 0.5, (GLfloat) 1.0);
 	glClear(GL_COLOR_BUFFER_BIT);
 
@@ -159,6 +394,8 @@ int init(const char *shadertoy, const struct options *options) {
 int main(int argc, char *argv[]) {
 	const char *shadertoy = NULL;
 	const char *perfcntr = NULL;
+	const char *perfcntr_output = NULL;
+	bool perfcntr_list = false;
 
 	struct options options = {
 			.connector = -1,
@@ -179,6 +416,20 @@ int main(int argc, char *argv[]) {
 			case 'A':
 				options.atomic_drm_mode = true;
 				break;
+			case 'b':
+				options.buffers = strtoul(optarg, NULL, 0);
+				if (options.buffers < 2 || options.buffers > MAX_BUFFERS) {
+					printf("invalid number of buffers: %s\n", optarg);
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'B':
+				options.build_times = true;
+				break;
+			case 'c':
+				options.capture = optarg;
+				break;
 			case 'C':
 				options.connector = strtoul(optarg, NULL, 0);
 				break;
@@ -199,18 +450,113 @@ int main(int argc, char *argv[]) {
 				options.format = fourcc_code(fourcc[0], fourcc[1], fourcc[2], fourcc[3]);
 				break;
 			}
+			case 'F':
+				options.fixed_fps = strtoul(optarg, NULL, 0);
+				if (!options.fixed_fps) {
+					printf("invalid frame rate: %s\n", optarg);
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'g':
+				options.gpu_timing = true;
+				break;
 			case 'h':
 				usage(argv[0]);
 				return 0;
+			case 'H':
+				options.headless = true;
+				if (optarg && sscanf(optarg, "%ux%u", &options.width, &options.height) != 2) {
+					printf("invalid framebuffer size: %s\n", optarg);
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'i':
+				options.build_info = true;
+				break;
+			case 'j':
+				options.jobs = optarg;
+				break;
+			case 'l':
+				options.latency_target = strtod(optarg, NULL) * MSEC_PER_SEC;
+				break;
+			case 'L':
+				perfcntr_list = true;
+				break;
 			case 'm':
 				options.modifier = strtoull(optarg, NULL, 0);
 				break;
+			case 'E':
+				options.async_compile = true;
+				break;
+			case 'N':
+				options.no_cache = true;
+				break;
 			case 'n':
 				options.frames = strtoul(optarg, NULL, 0);
 				break;
+			case 'o':
+				perfcntr_output = optarg;
+				break;
+			case 'O':
+				options.output = optarg;
+				break;
 			case 'p':
 				perfcntr = optarg;
 				break;
+			case 'P':
+				if (strcmp(optarg, "fifo") == 0) {
+					options.present_mode = PRESENT_MODE_FIFO;
+				} else if (strcmp(optarg, "mailbox") == 0) {
+					options.present_mode = PRESENT_MODE_MAILBOX;
+				} else if (strcmp(optarg, "immediate") == 0) {
+					options.present_mode = PRESENT_MODE_IMMEDIATE;
+				} else {
+					printf("invalid present mode: %s\n", optarg);
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'r':
+				options.profile = true;
+				break;
+			case 's':
+				if (!optarg || strcmp(optarg, "text") == 0) {
+					options.stats = STATS_TEXT;
+				} else if (strcmp(optarg, "json") == 0) {
+					options.stats = STATS_JSON;
+				} else {
+					printf("invalid stats format: %s\n", optarg);
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'S':
+				if (strcmp(optarg, "interleaved") == 0) {
+					options.shard = SHARD_INTERLEAVED;
+				} else if (strcmp(optarg, "contiguous") == 0) {
+					options.shard = SHARD_CONTIGUOUS;
+				} else {
+					printf("invalid shard: %s\n", optarg);
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 't':
+				if (strcmp(optarg, "draw") == 0) {
+					options.timing = TIMING_DRAW;
+				} else if (strcmp(optarg, "vblank") == 0) {
+					options.timing = TIMING_VBLANK;
+				} else {
+					printf("invalid timing: %s\n", optarg);
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'T':
+				options.trace = optarg;
+				break;
 			case 'v':
 				p = strchr(optarg, '-');
 				if (p == NULL) {
@@ -224,37 +570,145 @@ int main(int argc, char *argv[]) {
 				strncpy(options.mode, optarg, len);
 				options.mode[len] = '\0';
 				break;
+			case 'V':
+				options.vrr = true;
+				break;
+			case 'R':
+				options.sweep = optarg;
+				break;
+			case 'w':
+				options.wall = optarg;
+				break;
+			case 'W':
+				options.wall_sync = optarg;
+				break;
 			case 'x':
 				options.surfaceless = true;
 				break;
+			case 'z':
+				options.poster = optarg;
+				break;
 			default:
 				usage(argv[0]);
 				return -1;
 		}
 	}
 
+	if (perfcntr_list) {
+		return list_counters(&options) < 0 ? -1 : 0;
+	}
+
 	if (argc - optind != 1) {
 		usage(argv[0]);
 		return -1;
 	}
 	shadertoy = argv[optind];
 
+	if (options.poster && !options.output) {
+		printf("poster rendering requires an output file\n");
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (options.wall && options.output) {
+		printf("a wall can't be rendered offline\n");
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (options.sweep && (options.output || options.capture)) {
+		printf("a sweep can't be captured\n");
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (options.wall_sync && !options.wall) {
+		printf("wall sync requires a wall geometry\n");
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (options.jobs) {
+		bool worker;
+
+		if (!options.output) {
+			printf("parallel rendering requires an output file\n");
+			usage(argv[0]);
+			return -1;
+		}
+
+		/* returns in the workers, to render their shard of the frames: */
+		ret = render_parallel(&options, &worker);
+		if (!worker) {
+			return ret < 0 ? -1 : 0;
+		}
+	}
+
 	ret = init(shadertoy, &options);
 	if (ret < 0) {
 		return -1;
 	}
 
+	if (options.jobs) {
+		/* not to account for the startup of the workers: */
+		worker_ready();
+	}
+
 	if (perfcntr) {
-		init_perfcntrs(egl, perfcntr);
+		init_perfcntrs(egl, perfcntr, perfcntr_output);
+	}
+
+	if (builds) {
+		return report_build_times(shadertoy) < 0 ? -1 : 0;
+	}
+
+	if (poster) {
+		return render_poster(gbm, egl);
+	}
+
+	if (sweep) {
+		return render_sweep(gbm, egl);
 	}
 
-	return drm->run(gbm, egl);
+	if (offline) {
+		return render_offline(gbm, egl);
+	}
+
+	/* stop upon Ctrl-C as upon a keypress, going through the teardown,
+	 * e.g. to write the profile and trace, a second one exiting right away:
+	 */
+	struct sigaction action = {
+		.sa_handler = interrupted,
+		.sa_flags = SA_RESETHAND,
+	};
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	ret = drm->run(gbm, egl);
+	finish_shadertoy();
+
+	return ret;
 }
 
 void *thread_run() {
 	eglMakeCurrent(egl->display, egl->surface, egl->surface, egl->context);
 
-	return (void *) drm->run(gbm, egl);
+	if (poster) {
+		return (void *) (intptr_t) render_poster(gbm, egl);
+	}
+
+	if (sweep) {
+		return (void *) (intptr_t) render_sweep(gbm, egl);
+	}
+
+	if (offline) {
+		return (void *) (intptr_t) render_offline(gbm, egl);
+	}
+
+	void *ret = (void *) drm->run(gbm, egl);
+	finish_shadertoy();
+
+	return ret;
 }
 
 volatile pthread_t thread;
@@ -270,5 +724,6 @@ int join() {
 }
 
 void stop() {
-    pthread_cancel(thread);
+    /* for the run to go through its teardown, e.g. to print the stats: */
+    request_stop();
 }
@@ -34,4 +34,14 @@ extern void stop();
 extern void onInit(void callback(uint program, uint width, uint height));
 extern void onRender(void callback(uint64_t frame, float time));
 
+struct frame_stats {
+	uint64_t frames;
+	uint64_t missed;            /* frames presented after their vblank */
+	double p50, p95, p99;       /* in ms, over the recent frames */
+	double max;                 /* in ms */
+	uint64_t histogram[STATS_BUCKETS];
+};
+
+extern void get_stats(struct frame_stats *stats);
+
 #endif /* _GLSL_H */
@@ -9,7 +9,7 @@ import stat
 from contextlib import ExitStack
 from inotify import INotify, IN_CREATE, IN_ATTRIB
 from input import *
-from lib import options
+from lib import options, PRESENT_MODES, STATS_FORMATS, TIMINGS
 from libevdev import *
 from signal import pthread_sigmask, pthread_kill, sigwait
 from threading import main_thread
@@ -151,6 +151,40 @@ parser.add_argument('--mode', metavar='MODE', type=str,
                     help='specify the video mode in the format <resolution>[-<vrefresh>]')
 parser.add_argument('-n', '--frames', metavar='N', type=int,
                     help='run for the given number of frames and exit')
+parser.add_argument('-b', '--buffers', metavar='N', type=int, choices=range(2, 5),
+                    help='the number of buffers in surfaceless and headless modes (2-4, default: 2)')
+parser.add_argument('--present-mode', choices=PRESENT_MODES,
+                    help='the presentation mode (default: fifo)')
+parser.add_argument('--latency-target', metavar='MS', type=float,
+                    help='delay rendering so that it completes the given safety margin before the vblank')
+parser.add_argument('--timing', choices=TIMINGS,
+                    help='compute iTime from the time the frame starts rendering (default: draw), '
+                         'or from the time it\'s presented at')
+parser.add_argument('--fixed-fps', metavar='N', type=int,
+                    help='compute iTime, iTimeDelta and iDate from the frame index, as if rendering at N fps')
+parser.add_argument('--vrr', action=argparse.BooleanOptionalAction,
+                    help='enable variable refresh rate, if supported by the connector')
+parser.add_argument('--stats', choices=STATS_FORMATS[1:], nargs='?', const='text',
+                    help='report the frame time percentiles, missed deadlines and histogram (default: text)')
+parser.add_argument('--profile', action=argparse.BooleanOptionalAction,
+                    help='measure the CPU time spent in each phase of the frames, and report it upon exit')
+parser.add_argument('--trace', metavar='FILE', type=Path,
+                    help='write a Chrome trace of the frames upon exit, that can be opened with Perfetto')
+parser.add_argument('--gpu-timing', action=argparse.BooleanOptionalAction,
+                    help='measure the GPU time spent drawing the frames using the EXT_disjoint_timer_query extension')
+parser.add_argument('--build-info', action=argparse.BooleanOptionalAction,
+                    help='print the time spent building the program and first drawing with it, on startup')
+parser.add_argument('--headless', metavar='WxH', type=str, nargs='?', const='1920x1080',
+                    help='render into framebuffer objects of the given size (default: 1920x1080), without display')
+parser.add_argument('--capture', metavar='PATH', type=str,
+                    help='stream the frames to the given file, or to the standard output if -, '
+                         'as Y4M if it ends with .y4m or is -, raw I420 if it ends with .yuv or .i420, '
+                         'raw NV12 if it ends with .nv12, PNG files named after the path formatted with '
+                         'the frame index if it ends with .png, e.g. frame%%04d.png, and raw RGBA otherwise')
+parser.add_argument('--output', metavar='PATH', type=str,
+                    help='render the frames offline to the given file, in any of the capture formats, '
+                         'as fast as possible, at the fixed frame rate (default: 60 fps), without display '
+                         '(requires -n)')
 parser.add_argument('-k', '--keyboard', metavar='UNIFORM', type=str,
                     help='add keyboard')
 parser.add_argument('--touchscreen', metavar='UNIFORM', type=str,
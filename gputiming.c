@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include "common.h"
+
+/* Module to measure the GPU time spent drawing the frames, using the
+ * EXT_disjoint_timer_query extension.
+ *
+ * Call start_gpu_timing() before the draw(s) to measure, and end_gpu_timing()
+ * after them. The elapsed-time queries are issued into a ring, and their
+ * results are only collected once available, a few frames later, so that
+ * the pipeline never stalls. A frame is not measured if its slot in the
+ * ring is still busy.
+ */
+
+#define GPU_QUERIES 8
+
+static struct {
+	const struct egl *egl;
+
+	GLuint queries[GPU_QUERIES];
+	bool pending[GPU_QUERIES];
+	unsigned current, oldest;
+	bool active;
+
+	uint64_t frames;
+	uint64_t total;
+	uint64_t max;
+} gpu;
+
+void init_gpu_timing(const struct egl *egl)
+{
+	if (egl_check(egl, glGenQueriesEXT) ||
+	    egl_check(egl, glBeginQueryEXT) ||
+	    egl_check(egl, glEndQueryEXT) ||
+	    egl_check(egl, glGetQueryObjectuivEXT) ||
+	    egl_check(egl, glGetQueryObjectui64vEXT)) {
+		printf("EXT_disjoint_timer_query is not supported\n");
+		return;
+	}
+
+	egl->glGenQueriesEXT(GPU_QUERIES, gpu.queries);
+
+	gpu.egl = egl;
+}
+
+/* Collect the results of the queries that are available, in order: */
+static void collect_queries(void)
+{
+	const struct egl *egl = gpu.egl;
+	GLint disjoint = 0;
+
+	/* the results are invalid if a disjoint operation occurred, e.g.
+	 * a GPU frequency change, while any of the queries was active:
+	 */
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+	while (gpu.pending[gpu.oldest]) {
+		GLuint query = gpu.queries[gpu.oldest];
+		GLuint available = 0;
+		GLuint64 elapsed;
+
+		egl->glGetQueryObjectuivEXT(query, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+		if (!available && !disjoint)
+			break;
+
+		if (!disjoint) {
+			egl->glGetQueryObjectui64vEXT(query, GL_QUERY_RESULT_EXT, &elapsed);
+			gpu.frames++;
+			gpu.total += elapsed;
+			gpu.max = MAX2(gpu.max, elapsed);
+		}
+
+		gpu.pending[gpu.oldest] = false;
+		gpu.oldest = (gpu.oldest + 1) % GPU_QUERIES;
+	}
+}
+
+void start_gpu_timing(void)
+{
+	const struct egl *egl = gpu.egl;
+
+	if (!egl)
+		return;
+
+	collect_queries();
+
+	/* the slot is still busy, don't measure this frame: */
+	if (gpu.pending[gpu.current])
+		return;
+
+	egl->glBeginQueryEXT(GL_TIME_ELAPSED_EXT, gpu.queries[gpu.current]);
+	gpu.pending[gpu.current] = true;
+	gpu.active = true;
+}
+
+void end_gpu_timing(void)
+{
+	const struct egl *egl = gpu.egl;
+
+	if (!egl || !gpu.active)
+		return;
+
+	egl->glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+	gpu.active = false;
+	gpu.current = (gpu.current + 1) % GPU_QUERIES;
+}
+
+void dump_gpu_timing(unsigned nframes, uint64_t elapsed_time_ns)
+{
+	const double ms = NSEC_PER_SEC / MSEC_PER_SEC;
+
+	if (!gpu.egl || !nframes)
+		return;
+
+	collect_queries();
+
+	printf("GPU time: %.3f ms/frame (max %.3f ms), CPU frame time: %.3f ms/frame\n",
+	       gpu.frames ? gpu.total / ms / gpu.frames : 0, gpu.max / ms,
+	       elapsed_time_ns / ms / nframes);
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "drm-common.h"
+
+/* Backend rendering into framebuffer objects, without any display, e.g. to
+ * benchmark shaders on machines with no DRM device, using llvmpipe. The
+ * offline rendering renders into them the same way, through the ring.
+ */
+
+static struct drm drm;
+
+static bool user_interrupted(void)
+{
+	struct pollfd pfd = {
+			.fd = 0,
+			.events = POLLIN,
+	};
+
+	if (poll(&pfd, 1, 0) > 0) {
+		printf("user interrupted!\n");
+		return true;
+	}
+
+	return false;
+}
+
+void init_fbo_ring(struct fbo_ring *ring, const struct gbm *gbm, const struct egl *egl)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->count = gbm->num_bos;
+	ring->fenced = egl->eglCreateSyncKHR && egl->eglClientWaitSyncKHR;
+}
+
+/* Returns the buffer to render the ith frame into, once the rendering of
+ * the previous frame into it has completed:
+ */
+unsigned acquire_fbo(struct fbo_ring *ring, const struct egl *egl, unsigned i)
+{
+	unsigned buffer = i % ring->count;
+
+	if (ring->fences[buffer]) {
+		uint64_t wait_start = profile_begin();
+		egl->eglClientWaitSyncKHR(egl->display, ring->fences[buffer],
+				EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+		profile_end(PHASE_WAIT, wait_start);
+		egl->eglDestroySyncKHR(egl->display, ring->fences[buffer]);
+		ring->fences[buffer] = NULL;
+	}
+
+	return buffer;
+}
+
+/* Draw the frame into the buffer, and capture it, if enabled: */
+void render_fbo(struct fbo_ring *ring, const struct egl *egl, unsigned buffer,
+                uint64_t start_time, unsigned frame, uint64_t present_time)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, egl->fbs[buffer].fb);
+
+	uint64_t phase_start = profile_begin();
+	egl->draw(start_time, frame, present_time);
+	profile_end(PHASE_DRAW, phase_start);
+
+	phase_start = profile_begin();
+	capture_frame(frame);
+	profile_end(PHASE_CAPTURE, phase_start);
+
+	if (ring->fenced) {
+		ring->fences[buffer] = egl->eglCreateSyncKHR(egl->display,
+				EGL_SYNC_FENCE_KHR, NULL);
+		phase_start = profile_begin();
+		glFlush();
+		profile_end(PHASE_SWAP, phase_start);
+	} else {
+		phase_start = profile_begin();
+		glFinish();
+		profile_end(PHASE_FINISH, phase_start);
+	}
+}
+
+void finish_fbo_ring(struct fbo_ring *ring, const struct egl *egl)
+{
+	glFinish();
+
+	for (unsigned i = 0; i < ring->count; i++) {
+		if (ring->fences[i])
+			egl->eglDestroySyncKHR(egl->display, ring->fences[i]);
+	}
+}
+
+static int headless_run(const struct gbm *gbm, const struct egl *egl)
+{
+	struct fbo_ring ring;
+	uint32_t i = 0;
+	uint64_t start_time, report_time, cur_time;
+
+	/* Only check for user input from a terminal, e.g. not to stop right
+	 * away when stdin is redirected from /dev/null on build servers:
+	 */
+	bool interactive = isatty(0);
+
+	init_fbo_ring(&ring, gbm, egl);
+
+	start_time = report_time = get_time_ns();
+
+	while (drm.frames == 0 || i < drm.frames) {
+		if ((interactive && user_interrupted()) || stop_requested())
+			break;
+
+		unsigned buffer = acquire_fbo(&ring, egl, i);
+
+		/* Start fps measuring on second frame, to remove the time spent
+		 * compiling shader, etc, from the fps:
+		 */
+		if (i == 1) {
+			start_time = report_time = get_time_ns();
+		}
+
+		/* without page flips, measure the frame times from the start
+		 * of the frames, leaving the first one out as well:
+		 */
+		if (i > 0) {
+			stats_frame(i, get_time_ns());
+		}
+
+		uint64_t present_time = 0;
+		if (drm.timing == TIMING_FIXED) {
+			present_time = fixed_present_time(&drm, start_time, i);
+		}
+
+		render_fbo(&ring, egl, buffer, start_time, i++, present_time);
+
+		cur_time = get_time_ns();
+		if (cur_time > (report_time + 2 * NSEC_PER_SEC)) {
+			double elapsed_time = cur_time - start_time;
+			double secs = elapsed_time / (double) NSEC_PER_SEC;
+			unsigned frames = i - 1;  /* first frame ignored */
+			printf("Rendered %u frames in %f sec (%f fps)\n",
+			       frames, secs, (double) frames / secs);
+			dump_gpu_timing(frames, elapsed_time);
+			dump_stats();
+			report_time = cur_time;
+		}
+	}
+
+	finish_fbo_ring(&ring, egl);
+
+	finish_perfcntrs();
+	finish_capture();
+
+	cur_time = get_time_ns();
+	double elapsed_time = cur_time - start_time;
+	double secs = elapsed_time / (double) NSEC_PER_SEC;
+	unsigned frames = i - 1;  /* first frame ignored */
+	printf("Rendered %u frames in %f sec (%f fps)\n",
+	       frames, secs, (double) frames / secs);
+
+	dump_perfcntrs(frames, elapsed_time);
+	dump_gpu_timing(frames, elapsed_time);
+	dump_stats();
+	dump_profile();
+
+	return 0;
+}
+
+const struct drm * init_headless(const struct options *options)
+{
+	drm.fd = -1;
+	drm.kms_in_fence_fd = -1;
+	drm.kms_out_fence_fd = -1;
+	drm.frames = options->frames;
+	drm.timing = options->fixed_fps ? TIMING_FIXED : TIMING_DRAW;
+	drm.fixed_fps = options->fixed_fps;
+	drm.run = headless_run;
+
+	return &drm;
+}
@@ -15,9 +15,54 @@ class OPTIONS(Structure):
         ("surfaceless",     c_bool),
         ("vrefresh",        c_int),
         ("frames",          c_uint),
+        ("buffers",         c_uint),
+        ("present_mode",    c_int),
+        ("latency_target",  c_uint),
+        ("timing",          c_int),
+        ("vrr",             c_bool),
+        ("stats",           c_int),
+        ("profile",         c_bool),
+        ("trace",           c_char_p),
+        ("gpu_timing",      c_bool),
+        ("headless",        c_bool),
+        ("width",           c_uint),
+        ("height",          c_uint),
+        ("fixed_fps",       c_uint),
+        ("capture",         c_char_p),
+        ("output",          c_char_p),
+        ("jobs",            c_char_p),
+        ("shard",           c_int),
+        ("poster",          c_char_p),
+        ("wall",            c_char_p),
+        ("wall_sync",       c_char_p),
+        ("sweep",           c_char_p),
+        ("build_times",     c_bool),
+        ("no_cache",        c_bool),
+        ("async_compile",   c_bool),
+        ("build_info",      c_bool),
     ]
 
 
+STATS_BUCKETS = 64
+
+
+class STATS(Structure):
+    _fields_ = [
+        ("frames",    c_uint64),
+        ("missed",    c_uint64),
+        ("p50",       c_double),
+        ("p95",       c_double),
+        ("p99",       c_double),
+        ("max",       c_double),
+        ("histogram", c_uint64 * STATS_BUCKETS),
+    ]
+
+
+PRESENT_MODES = ['fifo', 'mailbox', 'immediate']
+TIMINGS = ['draw', 'vblank']
+STATS_FORMATS = ['none', 'text', 'json']
+
+
 def options(args):
     c_opts = OPTIONS()
     if args.async_page_flip:
@@ -34,4 +79,39 @@ def options(args):
         c_opts.mode = (c_ubyte * 32)(*bytes(args.mode, 'utf-8'))
     if args.frames:
         c_opts.frames = c_uint(args.frames)
+    if args.buffers:
+        c_opts.buffers = c_uint(args.buffers)
+    if args.present_mode:
+        c_opts.present_mode = c_int(PRESENT_MODES.index(args.present_mode))
+    if args.latency_target:
+        c_opts.latency_target = c_uint(int(args.latency_target * 1000))
+    if args.timing:
+        c_opts.timing = c_int(TIMINGS.index(args.timing))
+    if args.vrr:
+        c_opts.vrr = c_bool(True)
+    if args.stats:
+        c_opts.stats = c_int(STATS_FORMATS.index(args.stats))
+    if args.profile:
+        c_opts.profile = c_bool(True)
+    if args.trace:
+        c_opts.trace = bytes(args.trace.as_posix(), 'utf-8')
+    if args.gpu_timing:
+        c_opts.gpu_timing = c_bool(True)
+    if args.build_info:
+        c_opts.build_info = c_bool(True)
+    if args.headless:
+        c_opts.headless = c_bool(True)
+        (c_opts.width, c_opts.height) = map(int, args.headless.split('x'))
+    if args.fixed_fps:
+        c_opts.fixed_fps = c_uint(args.fixed_fps)
+    if args.capture:
+        c_opts.capture = bytes(args.capture, 'utf-8')
+    if args.output:
+        c_opts.output = bytes(args.output, 'utf-8')
     return c_opts
+
+
+def stats():
+    c_stats = STATS()
+    glsl.get_stats(byref(c_stats))
+    return c_stats
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include "common.h"
+
+/* Module to render a number of frames offline, into a file, as fast as
+ * possible, e.g. to pre-render content for playback devices.
+ *
+ * The frames are timed at a fixed frame rate, from their index, and rendered
+ * into the framebuffer objects of the headless backend, without any pacing.
+ * They are read back and written out by the capture module.
+ */
+
+static struct {
+	unsigned frames;
+	unsigned fps;
+
+	/* the frames rendered by this process: */
+	unsigned first, step, count;
+} offline;
+
+int init_offline(const struct options *options)
+{
+	if (!options->frames) {
+		printf("offline rendering requires the number of frames to render\n");
+		return -1;
+	}
+
+	offline.frames = options->frames;
+	offline.fps = options->fixed_fps ? options->fixed_fps : OFFLINE_FPS;
+
+	if (!offline.step)
+		shard_offline(0, 1, offline.frames);
+
+	return 0;
+}
+
+/* Render only the given frames, e.g. in the parallel workers: */
+void shard_offline(unsigned first, unsigned step, unsigned count)
+{
+	offline.first = first;
+	offline.step = step;
+	offline.count = count;
+}
+
+int render_offline(const struct gbm *gbm, const struct egl *egl)
+{
+	struct fbo_ring ring;
+	uint64_t start_time, report_time, cur_time;
+	unsigned i;
+
+	init_fbo_ring(&ring, gbm, egl);
+
+	start_time = report_time = get_time_ns();
+
+	for (i = 0; i < offline.count; i++) {
+		unsigned buffer = acquire_fbo(&ring, egl, i);
+		unsigned frame = offline.first + i * offline.step;
+
+		render_fbo(&ring, egl, buffer, start_time, frame,
+		           start_time + (uint64_t) frame * NSEC_PER_SEC / offline.fps);
+
+		cur_time = get_time_ns();
+		if (cur_time > (report_time + 2 * NSEC_PER_SEC)) {
+			double secs = (cur_time - start_time) / (double) NSEC_PER_SEC;
+			printf("Rendered %u/%u frames in %f sec (%f fps)\n",
+			       i + 1, offline.count, secs, (i + 1) / secs);
+			report_time = cur_time;
+		}
+	}
+
+	finish_fbo_ring(&ring, egl);
+
+	/* the frames are only rendered once written out: */
+	finish_capture();
+
+	cur_time = get_time_ns();
+	double elapsed_time = cur_time - start_time;
+	double secs = elapsed_time / (double) NSEC_PER_SEC;
+	double duration = (double) i / offline.fps;
+	printf("Rendered %u frames in %f sec (%f fps throughput, %.2fx real time at %u fps)\n",
+	       i, secs, i / secs, duration / secs, offline.fps);
+
+	dump_gpu_timing(i, elapsed_time);
+	dump_profile();
+
+	return 0;
+}
@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+
+/* Module to render the frames offline across worker processes, e.g. with
+ * llvmpipe on many-core machines, where a single process doesn't scale, or
+ * the bands of a poster, the same way.
+ *
+ * The coordinator forks the workers before initializing anything, each of
+ * which renders a shard of the frames, either interleaved or contiguous, as
+ * the frames are timed from their index. The frames are merged in order
+ * into the output stream, through a ring of slots per worker, in shared
+ * memory, guarded by process-shared semaphores, or written by the workers
+ * directly when the output is a file per frame.
+ *
+ * The number of workers can be a list, to measure how the throughput scales
+ * with it, by rendering the frames as many times, only the last run being
+ * written out. The workers only start rendering once all of them are
+ * initialized, for the throughput not to account for their startup, which
+ * is reported separately.
+ */
+
+#define MAX_JOBS 256
+#define MAX_RUNS 16
+#define WORKER_SLOTS 2
+
+struct worker_ring {
+	sem_t filled;   /* slots holding a frame */
+	sem_t free;     /* slots the worker can render into */
+	sem_t ready;    /* the worker is initialized */
+	sem_t start;    /* all the workers are, to start rendering */
+};
+
+static struct {
+	unsigned jobs;
+	bool poster;
+	unsigned items; /* frames, or bands of the poster */
+	size_t size;    /* of an item, in RGBA */
+
+	struct worker_ring *rings;
+	uint8_t *slots;
+	size_t length;  /* of the shared mapping */
+
+	pid_t pids[MAX_JOBS];
+	bool exited[MAX_JOBS];
+
+	/* in the workers: */
+	unsigned worker;
+	unsigned sent;
+} parallel;
+
+static uint8_t *worker_slot(unsigned worker, unsigned n)
+{
+	return parallel.slots + ((size_t) worker * WORKER_SLOTS + n % WORKER_SLOTS) * parallel.size;
+}
+
+static void send_frame(const uint8_t *pixels, unsigned frame)
+{
+	struct worker_ring *ring = &parallel.rings[parallel.worker];
+
+	(void) frame;
+
+	while (sem_wait(&ring->free) && errno == EINTR)
+		;
+	memcpy(worker_slot(parallel.worker, parallel.sent++), pixels, parallel.size);
+	sem_post(&ring->filled);
+}
+
+/* Called in the workers once initialized, to wait for the others to be: */
+void worker_ready(void)
+{
+	struct worker_ring *ring = &parallel.rings[parallel.worker];
+
+	sem_post(&ring->ready);
+	while (sem_wait(&ring->start) && errno == EINTR)
+		;
+}
+
+/* the first frame of the worker, and the number of frames it renders: */
+static void worker_shard(const struct options *options, unsigned worker,
+                         unsigned *first, unsigned *count)
+{
+	unsigned frames = parallel.items, jobs = parallel.jobs;
+
+	if (options->shard == SHARD_CONTIGUOUS) {
+		*first = (uint64_t) frames * worker / jobs;
+		*count = (uint64_t) frames * (worker + 1) / jobs - *first;
+	} else {
+		*first = worker;
+		*count = worker < frames ? (frames - worker + jobs - 1) / jobs : 0;
+	}
+}
+
+/* Wait for the worker to post the semaphore of its ring, e.g. to hand a
+ * frame over, failing if it exits first:
+ */
+static int wait_worker(unsigned worker, sem_t *sem)
+{
+	for (;;) {
+		struct timespec timeout;
+		int status;
+
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		timeout.tv_sec++;
+
+		if (!sem_timedwait(sem, &timeout))
+			return 0;
+		if (errno != ETIMEDOUT && errno != EINTR)
+			return -1;
+
+		if (!parallel.exited[worker]) {
+			if (waitpid(parallel.pids[worker], &status, WNOHANG) <= 0)
+				continue;
+			parallel.exited[worker] = true;
+		}
+
+		/* the frames sent before exiting are still to be merged, but
+		 * nothing else will be sent:
+		 */
+		if (!sem_trywait(sem))
+			return 0;
+		printf("worker %u exited before rendering all its frames\n", worker);
+		return -1;
+	}
+}
+
+static void kill_workers(void)
+{
+	for (unsigned i = 0; i < parallel.jobs; i++) {
+		if (!parallel.exited[i])
+			kill(parallel.pids[i], SIGTERM);
+	}
+}
+
+static int wait_workers(void)
+{
+	int ret = 0;
+
+	for (unsigned i = 0; i < parallel.jobs; i++) {
+		int status;
+
+		if (parallel.exited[i])
+			continue;
+		if (waitpid(parallel.pids[i], &status, 0) < 0 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status)) {
+			printf("worker %u failed\n", i);
+			ret = -1;
+		}
+		parallel.exited[i] = true;
+	}
+
+	return ret;
+}
+
+/* Merge the frames in order, from the worker rendering each of them: */
+static int merge_frames(const struct options *options, bool write)
+{
+	unsigned first, count, worker = 0;
+	unsigned received[MAX_JOBS] = {0};
+
+	worker_shard(options, 0, &first, &count);
+
+	for (unsigned frame = 0; frame < parallel.items; frame++) {
+		if (options->shard == SHARD_CONTIGUOUS) {
+			while (frame >= first + count)
+				worker_shard(options, ++worker, &first, &count);
+		} else {
+			worker = frame % parallel.jobs;
+		}
+
+		if (wait_worker(worker, &parallel.rings[worker].filled) < 0)
+			return -1;
+
+		const uint8_t *pixels = worker_slot(worker, received[worker]++);
+		bool written = !write || (parallel.poster ? write_poster_band(pixels, frame) :
+		                                            capture_pixels(pixels, frame));
+
+		sem_post(&parallel.rings[worker].free);
+		if (!written)
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Fork the workers, returning in each of them, to render their shard: */
+static int fork_workers(const struct options *options, bool *worker)
+{
+	for (unsigned i = 0; i < parallel.jobs; i++) {
+		struct worker_ring *ring = &parallel.rings[i];
+
+		sem_init(&ring->filled, 1, 0);
+		sem_init(&ring->free, 1, WORKER_SLOTS);
+		sem_init(&ring->ready, 1, 0);
+		sem_init(&ring->start, 1, 0);
+		parallel.exited[i] = false;
+	}
+
+	/* not to write the buffered output again from the workers: */
+	fflush(NULL);
+
+	for (unsigned i = 0; i < parallel.jobs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			printf("failed to fork worker %u: %s\n", i, strerror(errno));
+			parallel.jobs = i;
+			return -1;
+		}
+
+		if (pid == 0) {
+			unsigned first, count;
+
+			/* don't outlive the coordinator: */
+			prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+			/* only print the reports of the first worker: */
+			if (i > 0) {
+				int fd = open("/dev/null", O_WRONLY);
+				if (fd >= 0)
+					dup2(fd, STDOUT_FILENO);
+			}
+
+			parallel.worker = i;
+			worker_shard(options, i, &first, &count);
+			unsigned step = options->shard == SHARD_CONTIGUOUS ? 1 : parallel.jobs;
+			if (parallel.poster) {
+				shard_poster(first, step, count);
+				poster_to_sink(send_frame);
+			} else {
+				shard_offline(first, step, count);
+				if (!capture_per_frame())
+					capture_to_sink(send_frame);
+			}
+
+			*worker = true;
+			return 0;
+		}
+
+		parallel.pids[i] = pid;
+	}
+
+	return 0;
+}
+
+static void destroy_rings(unsigned jobs)
+{
+	for (unsigned i = 0; i < jobs; i++) {
+		struct worker_ring *ring = &parallel.rings[i];
+
+		sem_destroy(&ring->filled);
+		sem_destroy(&ring->free);
+		sem_destroy(&ring->ready);
+		sem_destroy(&ring->start);
+	}
+}
+
+/* Wait for all the workers to be initialized, before starting them all: */
+static int start_workers(void)
+{
+	for (unsigned i = 0; i < parallel.jobs; i++) {
+		if (wait_worker(i, &parallel.rings[i].ready) < 0)
+			return -1;
+	}
+
+	for (unsigned i = 0; i < parallel.jobs; i++)
+		sem_post(&parallel.rings[i].start);
+
+	return 0;
+}
+
+static unsigned parse_jobs(const char *list, unsigned *jobs)
+{
+	unsigned runs = 0;
+	char *end;
+
+	while (*list && runs < MAX_RUNS) {
+		unsigned long n = strtoul(list, &end, 0);
+
+		if (end == list || !n || n > MAX_JOBS || (*end && *end != ','))
+			return 0;
+		jobs[runs++] = n;
+		list = *end ? end + 1 : end;
+	}
+
+	return runs;
+}
+
+int render_parallel(const struct options *options, bool *worker)
+{
+	const double secs = NSEC_PER_SEC;
+	unsigned jobs[MAX_RUNS], runs, max_jobs = 0;
+	double fps[MAX_RUNS];
+	unsigned width = options->width ? options->width : HEADLESS_WIDTH;
+	unsigned height = options->height ? options->height : HEADLESS_HEIGHT;
+	int ret = 0;
+
+	*worker = false;
+
+	runs = parse_jobs(options->jobs, jobs);
+	if (!runs) {
+		printf("invalid number of jobs: %s (1-%u, comma separated)\n", options->jobs, MAX_JOBS);
+		return -1;
+	}
+	parallel.poster = options->poster != NULL;
+	if (parallel.poster) {
+		if (init_poster(options) < 0)
+			return -1;
+		parallel.items = poster_bands(&parallel.size);
+	} else if (!options->frames) {
+		printf("offline rendering requires the number of frames to render\n");
+		return -1;
+	} else {
+		parallel.items = options->frames;
+		parallel.size = (size_t) width * height * 4;
+	}
+
+	for (unsigned i = 0; i < runs; i++)
+		max_jobs = MAX2(max_jobs, jobs[i]);
+
+	/* The slots are shared by all the processes, and mapped before forking,
+	 * the pages being only touched once rendered into:
+	 */
+	parallel.length = max_jobs * (sizeof(struct worker_ring) + WORKER_SLOTS * parallel.size);
+	parallel.rings = mmap(NULL, parallel.length, PROT_READ | PROT_WRITE,
+	                      MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (parallel.rings == MAP_FAILED) {
+		printf("failed to map the shared frames: %s\n", strerror(errno));
+		return -1;
+	}
+	parallel.slots = (uint8_t *) (parallel.rings + max_jobs);
+
+	ret = parallel.poster ? open_poster(options->output) : open_capture(options->output);
+	if (ret < 0)
+		goto out;
+
+	for (unsigned run = 0; run < runs; run++) {
+		bool last = run == runs - 1;
+		uint64_t start_time = get_time_ns();
+
+		parallel.jobs = jobs[run];
+
+		ret = fork_workers(options, worker);
+		if (*worker)
+			return 0;
+		if (ret == 0)
+			ret = start_workers();
+		if (ret < 0) {
+			kill_workers();
+			wait_workers();
+			destroy_rings(jobs[run]);
+			goto out;
+		}
+
+		uint64_t ready_time = get_time_ns();
+		printf("Started %u worker(s) in %f sec\n", parallel.jobs,
+		       (ready_time - start_time) / secs);
+
+		if (run == 0 && !parallel.poster)
+			start_capture(width, height, options->fixed_fps ? options->fixed_fps : OFFLINE_FPS);
+
+		/* the workers write the files themselves, otherwise the frames
+		 * are merged, and only written out on the last run:
+		 */
+		if (!capture_per_frame()) {
+			ret = merge_frames(options, last);
+			if (ret < 0)
+				kill_workers();
+		}
+		if (wait_workers() < 0)
+			ret = -1;
+		destroy_rings(jobs[run]);
+		if (ret < 0)
+			goto out;
+
+		uint64_t elapsed_time = get_time_ns() - ready_time;
+		fps[run] = parallel.items * secs / elapsed_time;
+		printf("Rendered %u %s with %u worker(s) in %f sec (%f per sec)\n",
+		       parallel.items, parallel.poster ? "bands" : "frames", parallel.jobs,
+		       elapsed_time / secs, fps[run]);
+	}
+
+	if (runs > 1) {
+		printf("%8s %12s %10s %10s\n", "workers", "per sec", "speedup", "efficiency");
+		for (unsigned i = 0; i < runs; i++) {
+			double speedup = fps[i] / fps[0];
+			printf("%8u %12.3f %10.2f %9.0f%%\n", jobs[i], fps[i], speedup,
+			       100 * speedup * jobs[0] / jobs[i]);
+		}
+	}
+
+out:
+	if (parallel.poster) {
+		if (finish_poster() < 0)
+			ret = -1;
+	} else {
+		finish_capture();
+	}
+	munmap(parallel.rings, parallel.length);
+
+	return ret;
+}
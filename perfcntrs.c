@@ -40,6 +40,16 @@
  * Call start_perfcntrs() before the draw(s) to measure, and end_perfcntrs()
  * after the last draw to measure.  This can be done multiple times, with
  * the results accumulated.
+ *
+ * The results of each start_perfcntrs()/end_perfcntrs() pair can also be
+ * written as a time series, in CSV, or in JSON if the output file name ends
+ * with .json.
+ *
+ * When more counters are requested in a group than it can monitor at once,
+ * the counters are split into passes, that are rotated on every frame. The
+ * accumulated results are scaled to the number of frames of the run, as the
+ * frames of the other passes, or skipped when the results of the previous
+ * ones are not available yet, are not monitored.
  */
 
 /**
@@ -56,6 +66,15 @@ union counter_result {
  */
 struct counter {
 	union counter_result result;
+	/* number of results accumulated, to average the percentages, and
+	 * scale the other results when multiplexing:
+	 */
+	unsigned samples;
+	/* the pass this counter is monitored in: */
+	unsigned pass;
+	/* result of the monitor being collected, for the time series: */
+	union counter_result value;
+	bool sampled;
 	/* index into perfcntrs.groups[gidx].counters[cidx]
 	 * Note that the group_idx/counter_idx is not necessarily the
 	 * same as the group_id/counter_id.
@@ -90,6 +109,17 @@ struct gl_monitor {
 	GLuint id;
 	bool valid;
 	bool active;
+	unsigned frame;
+	/* the pass the counters selected in the monitor belong to: */
+	unsigned pass;
+	bool selected;
+};
+
+/* Entry of the (group_id, counter_id) index of the enabled counters: */
+struct counter_key {
+	GLuint group_id;
+	GLuint counter_id;
+	struct gl_counter *counter;
 };
 
 /**
@@ -99,12 +129,33 @@ static struct {
 	const struct egl *egl;
 
 	/* The extension doesn't let us pause/resume a single counter, so
-	 * instead use a sequence of monitors, one per start_perfcntrs()/
+	 * instead use a ring of monitors, one per start_perfcntrs()/
 	 * end_perfcntrs() pair, so that we don't need to immediately read
-	 * back a result, which could cause a stall.
+	 * back a result, which could cause a stall. The monitors are created
+	 * once, and reused once their results are collected.
 	 */
 	struct gl_monitor monitors[4];
 	unsigned current_monitor;
+	unsigned frame;
+
+	/* The number of passes the counters are split into, the number
+	 * of monitors collected, and of frames not monitored, as all the
+	 * monitors were still pending:
+	 */
+	unsigned num_passes;
+	unsigned pass;
+	unsigned monitored;
+	unsigned skipped;
+
+	/* The monitor results buffer, sized for all the enabled counters,
+	 * and the index of the enabled counters, sorted by their ids:
+	 */
+	GLuint *data;
+	GLuint data_size;
+	struct counter_key *keys;
+
+	/* The counters of a group to select in a monitor: */
+	GLuint *selection;
 
 	/* The requested counters to monitor:
 	 */
@@ -117,6 +168,11 @@ static struct {
 	GLint num_groups;
 	struct gl_counter_group *groups;
 
+	/* The time series output, if any: */
+	FILE *output;
+	bool json;
+	unsigned rows;
+
 } perfcntr;
 
 static void get_groups_and_counters(const struct egl *egl)
@@ -147,9 +203,6 @@ static void get_groups_and_counters(const struct egl *egl)
 		egl->glGetPerfMonitorCountersAMD(g->group_id, NULL, NULL,
 			g->num_counters, counter_ids);
 
-		printf("GROUP[%u]: name=%s, max_active_counters=%u, num_counters=%u\n",
-			g->group_id, g->name, g->max_active_counters, g->num_counters);
-
 		for (int j = 0; j < g->num_counters; j++) {
 			struct gl_counter *c = &g->counters[j];
 
@@ -164,9 +217,6 @@ static void get_groups_and_counters(const struct egl *egl)
 			egl->glGetPerfMonitorCounterInfoAMD(g->group_id,
 				c->counter_id, GL_COUNTER_TYPE_AMD,
 				&c->counter_type);
-
-			printf("\tCOUNTER[%u]: name=%s, counter_type=%04x\n",
-				c->counter_id, c->name, c->counter_type);
 		}
 	}
 }
@@ -202,10 +252,13 @@ static void add_counter(const char *name)
 
 	find_counter(name, &c->gidx, &c->cidx);
 
+	/* multiplex the counters that exceed the capacity of the group: */
 	struct gl_counter_group *g = &perfcntr.groups[c->gidx];
-	if (g->num_enabled_counters >= g->max_active_counters) {
-		errx(-1, "Too many counters in group '%s'", g->name);
+	if (g->max_active_counters <= 0) {
+		errx(-1, "No active counters in group '%s'", g->name);
 	}
+	c->pass = g->num_enabled_counters / g->max_active_counters;
+	perfcntr.num_passes = MAX2(perfcntr.num_passes, c->pass + 1);
 
 	g->num_enabled_counters++;
 }
@@ -227,25 +280,111 @@ static void find_counters(const char *perfcntrs)
 	add_counter(cnames);
 }
 
-void init_perfcntrs(const struct egl *egl, const char *perfcntrs)
+static int compare_keys(const void *a, const void *b)
 {
-	if (egl_check(egl, glGetPerfMonitorGroupsAMD) ||
-	    egl_check(egl, glGetPerfMonitorCountersAMD) ||
-	    egl_check(egl, glGetPerfMonitorGroupStringAMD) ||
-	    egl_check(egl, glGetPerfMonitorCounterStringAMD) ||
-	    egl_check(egl, glGetPerfMonitorCounterInfoAMD) ||
-	    egl_check(egl, glGenPerfMonitorsAMD) ||
-	    egl_check(egl, glDeletePerfMonitorsAMD) ||
-	    egl_check(egl, glSelectPerfMonitorCountersAMD) ||
-	    egl_check(egl, glBeginPerfMonitorAMD) ||
-	    egl_check(egl, glEndPerfMonitorAMD) ||
-	    egl_check(egl, glGetPerfMonitorCounterDataAMD)) {
+	const struct counter_key *x = a, *y = b;
+
+	if (x->group_id != y->group_id)
+		return x->group_id < y->group_id ? -1 : 1;
+	if (x->counter_id != y->counter_id)
+		return x->counter_id < y->counter_id ? -1 : 1;
+	return 0;
+}
+
+static void open_output(const char *output)
+{
+	size_t len = strlen(output);
+
+	perfcntr.output = fopen(output, "w");
+	if (!perfcntr.output)
+		err(-1, "Could not open %s", output);
+
+	perfcntr.json = len > 5 && strcmp(&output[len - 5], ".json") == 0;
+
+	if (perfcntr.json) {
+		fprintf(perfcntr.output, "[\n");
+		return;
+	}
+
+	fprintf(perfcntr.output, "frame");
+	for (unsigned i = 0; i < perfcntr.num_counters; i++) {
+		struct counter *c = &perfcntr.counters[i];
+
+		fprintf(perfcntr.output, ",%s",
+			perfcntr.groups[c->gidx].counters[c->cidx].name);
+	}
+	fprintf(perfcntr.output, "\n");
+}
+
+static bool check_perfcntrs(const struct egl *egl)
+{
+	return !(egl_check(egl, glGetPerfMonitorGroupsAMD) ||
+	         egl_check(egl, glGetPerfMonitorCountersAMD) ||
+	         egl_check(egl, glGetPerfMonitorGroupStringAMD) ||
+	         egl_check(egl, glGetPerfMonitorCounterStringAMD) ||
+	         egl_check(egl, glGetPerfMonitorCounterInfoAMD) ||
+	         egl_check(egl, glGenPerfMonitorsAMD) ||
+	         egl_check(egl, glDeletePerfMonitorsAMD) ||
+	         egl_check(egl, glSelectPerfMonitorCountersAMD) ||
+	         egl_check(egl, glBeginPerfMonitorAMD) ||
+	         egl_check(egl, glEndPerfMonitorAMD) ||
+	         egl_check(egl, glGetPerfMonitorCounterDataAMD));
+}
+
+static const char *counter_type_name(GLuint counter_type)
+{
+	switch (counter_type) {
+	case GL_UNSIGNED_INT:
+		return "uint";
+	case GL_FLOAT:
+		return "float";
+	case GL_UNSIGNED_INT64_AMD:
+		return "uint64";
+	case GL_PERCENTAGE_AMD:
+		return "percentage";
+	default:
+		return "unknown";
+	}
+}
+
+void list_perfcntrs(const struct egl *egl)
+{
+	if (!check_perfcntrs(egl)) {
+		errx(-1, "AMD_performance_monitor is not supported");
+	}
+
+	get_groups_and_counters(egl);
+
+	for (int i = 0; i < perfcntr.num_groups; i++) {
+		struct gl_counter_group *g = &perfcntr.groups[i];
+
+		printf("GROUP[%u]: name=%s, max_active_counters=%u, num_counters=%u\n",
+			g->group_id, g->name, g->max_active_counters, g->num_counters);
+
+		for (int j = 0; j < g->num_counters; j++) {
+			struct gl_counter *c = &g->counters[j];
+
+			printf("\tCOUNTER[%u]: name=%s, counter_type=%04x (%s)\n",
+				c->counter_id, c->name, c->counter_type,
+				counter_type_name(c->counter_type));
+		}
+	}
+}
+
+void init_perfcntrs(const struct egl *egl, const char *perfcntrs, const char *output)
+{
+	if (!check_perfcntrs(egl)) {
 		errx(-1, "AMD_performance_monitor is not supported");
 	}
 
 	get_groups_and_counters(egl);
 	find_counters(perfcntrs);
 
+	if (perfcntr.num_passes > 1) {
+		printf("Monitoring the counters in %u passes, rotated on every frame\n",
+			perfcntr.num_passes);
+	}
+
 	/* setup enabled counters.. do this after realloc() stuff,
 	 * otherwise the counter pointer may not be valid:
 	 */
@@ -254,19 +393,42 @@ void init_perfcntrs(const struct egl *egl, const char *perfcntrs)
 		perfcntr.groups[c->gidx].counters[c->cidx].counter = c;
 	}
 
+	/* index the enabled counters by ids, to look the results up: */
+	perfcntr.keys = calloc(perfcntr.num_counters, sizeof(struct counter_key));
+	for (unsigned i = 0; i < perfcntr.num_counters; i++) {
+		struct counter *c = &perfcntr.counters[i];
+		struct gl_counter_group *g = &perfcntr.groups[c->gidx];
+
+		perfcntr.keys[i] = (struct counter_key) {
+			.group_id = g->group_id,
+			.counter_id = g->counters[c->cidx].counter_id,
+			.counter = &g->counters[c->cidx],
+		};
+	}
+	qsort(perfcntr.keys, perfcntr.num_counters, sizeof(struct counter_key),
+		compare_keys);
+
+	/* each result is made of the group id, the counter id, and a value
+	 * of up to 64 bits:
+	 */
+	perfcntr.data_size = perfcntr.num_counters * 4 * sizeof(GLuint);
+	perfcntr.data = malloc(perfcntr.data_size);
+	perfcntr.selection = malloc(perfcntr.num_counters * sizeof(GLuint));
+
+	for (unsigned i = 0; i < ARRAY_SIZE(perfcntr.monitors); i++)
+		egl->glGenPerfMonitorsAMD(1, &perfcntr.monitors[i].id);
+
+	if (output)
+		open_output(output);
+
 	perfcntr.egl = egl;
 }
 
-/* Create perf-monitor, and configure the counters it will monitor */
-static void init_monitor(struct gl_monitor *m)
+/* Select, or deselect, the counters of the given pass in the monitor */
+static void select_counters(struct gl_monitor *m, unsigned pass, GLboolean enable)
 {
 	const struct egl *egl = perfcntr.egl;
 
-	assert(!m->valid);
-	assert(!m->active);
-
-	egl->glGenPerfMonitorsAMD(1, &m->id);
-
 	for (int i = 0; i < perfcntr.num_groups; i++) {
 		struct gl_counter_group *g = &perfcntr.groups[i];
 
@@ -274,21 +436,39 @@ static void init_monitor(struct gl_monitor *m)
 			continue;
 
 		int idx = 0;
-		GLuint counters[g->num_enabled_counters];
 
 		for (int j = 0; j < g->num_counters; j++) {
 			struct gl_counter *c = &g->counters[j];
 
-			if (!c->counter)
+			if (!c->counter || c->counter->pass != pass)
 				continue;
 
-			assert(idx < g->num_enabled_counters);
-			counters[idx++] = c->counter_id;
+			assert(idx < g->max_active_counters);
+			perfcntr.selection[idx++] = c->counter_id;
 		}
 
-		assert(idx == g->num_enabled_counters);
-		egl->glSelectPerfMonitorCountersAMD(m->id, GL_TRUE,
-			g->group_id, g->num_enabled_counters, counters);
+		if (!idx)
+			continue;
+
+		egl->glSelectPerfMonitorCountersAMD(m->id, enable,
+			g->group_id, idx, perfcntr.selection);
+	}
+}
+
+/* Configure the counters of the given pass the monitor will monitor, which
+ * are only selected again when it monitored another pass before
+ */
+static void init_monitor(struct gl_monitor *m, unsigned pass)
+{
+	assert(!m->valid);
+	assert(!m->active);
+
+	if (!m->selected || m->pass != pass) {
+		if (m->selected)
+			select_counters(m, m->pass, GL_FALSE);
+		select_counters(m, pass, GL_TRUE);
+		m->pass = pass;
+		m->selected = true;
 	}
 
 	m->valid = true;
@@ -296,43 +476,86 @@ static void init_monitor(struct gl_monitor *m)
 
 static struct gl_counter *lookup_counter(GLuint group_id, GLuint counter_id)
 {
-	for (int i = 0; i < perfcntr.num_groups; i++) {
-		struct gl_counter_group *g = &perfcntr.groups[i];
+	struct counter_key key = {
+		.group_id = group_id,
+		.counter_id = counter_id,
+	};
+	struct counter_key *k;
+
+	k = bsearch(&key, perfcntr.keys, perfcntr.num_counters,
+		sizeof(struct counter_key), compare_keys);
+	if (!k) {
+		errx(-1, "invalid counter: group_id=%u, counter_id=%u",
+			group_id, counter_id);
+	}
 
-		if (g->group_id != group_id)
-			continue;
+	return k->counter;
+}
 
-		for (int j = 0; j < g->num_counters; j++) {
-			struct gl_counter *c = &g->counters[j];
+static void write_value(GLuint counter_type, const union counter_result *value)
+{
+	FILE *output = perfcntr.output;
+
+	switch (counter_type) {
+	case GL_UNSIGNED_INT:
+		fprintf(output, "%u", value->u32);
+		break;
+	case GL_FLOAT:
+	case GL_PERCENTAGE_AMD:
+		fprintf(output, "%f", value->f);
+		break;
+	case GL_UNSIGNED_INT64_AMD:
+		fprintf(output, "%"PRIu64, value->u64);
+		break;
+	}
+}
 
-			if (c->counter_id != counter_id)
-				continue;
+/* Write the counters sampled by a monitor, in the requested order, leaving
+ * the ones of the other passes empty:
+ */
+static void write_row(unsigned frame)
+{
+	FILE *output = perfcntr.output;
+	if (perfcntr.json)
+		fprintf(output, "%s{\"frame\": %u", perfcntr.rows ? ",\n" : "", frame);
+	else
+		fprintf(output, "%u", frame);
 
-			return c;
+	for (unsigned i = 0; i < perfcntr.num_counters; i++) {
+		struct counter *c = &perfcntr.counters[i];
+		struct gl_counter *gc = &perfcntr.groups[c->gidx].counters[c->cidx];
+
+		if (perfcntr.json) {
+			if (!c->sampled)
+				continue;
+			fprintf(output, ", \"%s\": ", gc->name);
+		} else {
+			fprintf(output, ",");
+			if (!c->sampled)
+				continue;
 		}
+		write_value(gc->counter_type, &c->value);
 	}
 
-	errx(-1, "invalid counter: group_id=%u, counter_id=%u",
-		group_id, counter_id);
+	fprintf(output, perfcntr.json ? "}" : "\n");
+	perfcntr.rows++;
 }
 
-/* Collect monitor results and delete monitor */
+/* Collect monitor results, for the monitor to be reused */
 static void finish_monitor(struct gl_monitor *m)
 {
 	const struct egl *egl = perfcntr.egl;
+	GLuint *data = perfcntr.data;
 
 	assert(m->valid);
 	assert(!m->active);
 
-	GLuint result_size;
-	egl->glGetPerfMonitorCounterDataAMD(m->id, GL_PERFMON_RESULT_SIZE_AMD,
-		sizeof(GLint), &result_size, NULL);
-
-	GLuint *data = malloc(result_size);
-
 	GLsizei bytes_written;
 	egl->glGetPerfMonitorCounterDataAMD(m->id, GL_PERFMON_RESULT_AMD,
-			result_size, data, &bytes_written);
+			perfcntr.data_size, data, &bytes_written);
+
+	for (unsigned i = 0; i < perfcntr.num_counters; i++)
+		perfcntr.counters[i].sampled = false;
 
 	GLsizei idx = 0;
 	while ((4 * idx) < bytes_written) {
@@ -343,31 +566,54 @@ static void finish_monitor(struct gl_monitor *m)
 
 		assert(c->counter);
 
+		union counter_result *value = &c->counter->value;
+
 		switch(c->counter_type) {
 		case GL_UNSIGNED_INT:
-			c->counter->result.u32 += *(uint32_t *)(&data[idx]);
+			value->u32 = *(uint32_t *)(&data[idx]);
+			c->counter->result.u32 += value->u32;
 			idx += 1;
 			break;
 		case GL_FLOAT:
-			c->counter->result.f += *(float *)(&data[idx]);
+		case GL_PERCENTAGE_AMD:
+			value->f = *(float *)(&data[idx]);
+			c->counter->result.f += value->f;
 			idx += 1;
 			break;
 		case GL_UNSIGNED_INT64_AMD:
-			c->counter->result.u64 += *(uint64_t *)(&data[idx]);
+			value->u64 = *(uint64_t *)(&data[idx]);
+			c->counter->result.u64 += value->u64;
 			idx += 2;
 			break;
-		case GL_PERCENTAGE_AMD:
 		default:
 			errx(-1, "TODO unhandled counter type: 0x%04x",
 				c->counter_type);
 			break;
 		}
+
+		c->counter->sampled = true;
+		c->counter->samples++;
 	}
 
-	egl->glDeletePerfMonitorsAMD(1, &m->id);
+	if (perfcntr.output)
+		write_row(m->frame);
+
+	perfcntr.monitored++;
+
 	m->valid = false;
 }
 
+static bool monitor_available(struct gl_monitor *m)
+{
+	const struct egl *egl = perfcntr.egl;
+	GLuint available = 0;
+
+	egl->glGetPerfMonitorCounterDataAMD(m->id, GL_PERFMON_RESULT_AVAILABLE_AMD,
+		sizeof(GLuint), &available, NULL);
+
+	return available;
+}
+
 void start_perfcntrs(void)
 {
 	const struct egl *egl = perfcntr.egl;
@@ -379,14 +625,24 @@ void start_perfcntrs(void)
 	struct gl_monitor *m = &perfcntr.monitors[perfcntr.current_monitor];
 
 	/* once we wrap-around and start re-using existing slots, collect
-	 * previous results and delete the monitor before re-using the slot:
+	 * previous results before re-using the monitor of the slot,
+	 * unless they are not available yet, in which case reading them
+	 * would stall, and the current frame is not monitored:
 	 */
 	if (m->valid) {
+		if (!monitor_available(m)) {
+			perfcntr.frame++;
+			perfcntr.skipped++;
+			return;
+		}
 		finish_monitor(m);
 	}
 
-	init_monitor(m);
+	/* rotate the pass of counters to monitor: */
+	init_monitor(m, perfcntr.pass);
+	perfcntr.pass = (perfcntr.pass + 1) % perfcntr.num_passes;
 
+	m->frame = perfcntr.frame++;
 	egl->glBeginPerfMonitorAMD(m->id);
 	m->active = true;
 }
@@ -401,8 +657,12 @@ void end_perfcntrs(void)
 
 	struct gl_monitor *m = &perfcntr.monitors[perfcntr.current_monitor];
 
+	/* the frame was skipped by start_perfcntrs(): */
+	if (!m->active) {
+		return;
+	}
+
 	assert(m->valid);
-	assert(m->active);
 
 	/* end collection, but defer collecting results to avoid stall: */
 	egl->glEndPerfMonitorAMD(m->id);
@@ -424,13 +684,24 @@ void finish_perfcntrs(void)
 	if (!perfcntr.egl)
 		return;
 
-	/* collect any remaining results, it really doesn't matter the order */
+	/* collect any remaining results, oldest first, for the time series: */
 	for (unsigned i = 0; i < ARRAY_SIZE(perfcntr.monitors); i++) {
-		struct gl_monitor *m = &perfcntr.monitors[i];
+		unsigned idx = (perfcntr.current_monitor + i) % ARRAY_SIZE(perfcntr.monitors);
+		struct gl_monitor *m = &perfcntr.monitors[idx];
 		if (m->valid) {
 			finish_monitor(m);
 		}
 	}
+
+	for (unsigned i = 0; i < ARRAY_SIZE(perfcntr.monitors); i++)
+		perfcntr.egl->glDeletePerfMonitorsAMD(1, &perfcntr.monitors[i].id);
+
+	if (perfcntr.output) {
+		if (perfcntr.json)
+			fprintf(perfcntr.output, "\n]\n");
+		fclose(perfcntr.output);
+		perfcntr.output = NULL;
+	}
 }
 
 void dump_perfcntrs(unsigned nframes, uint64_t elapsed_time_ns)
@@ -439,6 +710,21 @@ void dump_perfcntrs(unsigned nframes, uint64_t elapsed_time_ns)
 		return;
 	}
 
+	if (perfcntr.skipped) {
+		unsigned frames = perfcntr.monitored + perfcntr.skipped;
+
+		printf("Monitored %u of %u frames, %u skipped as the results of the "
+			"%zu previous frames were not available yet\n",
+			perfcntr.monitored, frames, perfcntr.skipped,
+			ARRAY_SIZE(perfcntr.monitors));
+		/* the GPU runs more frames behind than there are monitors: */
+		if (perfcntr.skipped * 4 > frames) {
+			printf("warning: %.0f%% of the frames were not monitored, "
+				"the results are extrapolated from the others\n",
+				100.0 * perfcntr.skipped / frames);
+		}
+	}
+
 	/* print column headers: */
 	printf("FPS");
 	for (unsigned i = 0; i < perfcntr.num_counters; i++) {
@@ -454,19 +740,28 @@ void dump_perfcntrs(unsigned nframes, uint64_t elapsed_time_ns)
 	for (unsigned i = 0; i < perfcntr.num_counters; i++) {
 		struct counter *c = &perfcntr.counters[i];
 
+		/* extrapolate the results of the frames the counter was
+		 * monitored in, to all the frames of the run, i.e. including
+		 * the frames of the other passes, and the skipped ones:
+		 */
+		double scale = c->samples ? nframes / (double)c->samples : 0;
+
 		GLuint counter_type =
 			perfcntr.groups[c->gidx].counters[c->cidx].counter_type;
 		switch (counter_type) {
 		case GL_UNSIGNED_INT:
-			printf(",%u", c->result.u32);
+			printf(",%.0f", c->result.u32 * scale);
 			break;
 		case GL_FLOAT:
-			printf(",%f", c->result.f);
+			printf(",%f", c->result.f * scale);
 			break;
 		case GL_UNSIGNED_INT64_AMD:
-			printf(",%"PRIu64, c->result.u64);
+			printf(",%.0f", c->result.u64 * scale);
 			break;
 		case GL_PERCENTAGE_AMD:
+			/* percentages don't add up, print the average: */
+			printf(",%f", c->samples ? c->result.f / c->samples : 0);
+			break;
 		default:
 			errx(-1, "TODO unhandled counter type: 0x%04x",
 				counter_type);
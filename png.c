@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+/* Module to write RGB PNG images, streaming the rows in, e.g. as they are
+ * read back, without holding the whole image in memory.
+ *
+ * The image data is not compressed, but stored in deflate blocks, which
+ * keeps it dependency free and about as fast as writing raw pixels. Each
+ * call to png_write_rows() writes an IDAT chunk, and png_end() terminates
+ * the deflate stream with an empty final block.
+ */
+
+#define PNG_BLOCK_SIZE 65535  /* the maximum size of a stored block */
+
+static uint32_t crc_table[256];
+
+static void init_crc_table(void)
+{
+	for (uint32_t n = 0; n < 256; n++) {
+		uint32_t c = n;
+		for (unsigned k = 0; k < 8; k++)
+			c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		crc_table[n] = c;
+	}
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+static void adler32_update(struct png *png, const uint8_t *data, size_t size)
+{
+	while (size) {
+		/* the sums cannot overflow before reducing them: */
+		size_t n = MIN2(size, 5552);
+
+		for (size_t i = 0; i < n; i++) {
+			png->adler_a += data[i];
+			png->adler_b += png->adler_a;
+		}
+		png->adler_a %= 65521;
+		png->adler_b %= 65521;
+
+		data += n;
+		size -= n;
+	}
+}
+
+static void put_be32(uint8_t *p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+}
+
+/* Writes data into the current chunk: */
+static void png_write(struct png *png, const void *data, size_t size)
+{
+	png->crc = crc32_update(png->crc, data, size);
+	if (fwrite(data, 1, size, png->file) != size)
+		png->failed = true;
+}
+
+static void png_begin_chunk(struct png *png, const char *type, uint32_t size)
+{
+	uint8_t length[4];
+
+	put_be32(length, size);
+	if (fwrite(length, 1, 4, png->file) != 4)
+		png->failed = true;
+
+	png->crc = 0xffffffff;
+	png_write(png, type, 4);
+}
+
+static void png_end_chunk(struct png *png)
+{
+	uint8_t crc[4];
+
+	put_be32(crc, png->crc ^ 0xffffffff);
+	if (fwrite(crc, 1, 4, png->file) != 4)
+		png->failed = true;
+}
+
+/* Writes deflate data, starting a new stored block every PNG_BLOCK_SIZE
+ * bytes:
+ */
+static void png_write_data(struct png *png, const uint8_t *data, size_t size)
+{
+	adler32_update(png, data, size);
+
+	while (size) {
+		if (!png->block) {
+			size_t n = MIN2(png->remaining, PNG_BLOCK_SIZE);
+			uint8_t header[5] = { 0, n, n >> 8, ~n, ~n >> 8 };
+
+			png_write(png, header, sizeof(header));
+			png->block = n;
+		}
+
+		size_t n = MIN2(size, png->block);
+		png_write(png, data, n);
+		png->block -= n;
+		png->remaining -= n;
+		data += n;
+		size -= n;
+	}
+}
+
+bool png_begin(struct png *png, FILE *file, unsigned width, unsigned height)
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	/* zlib header, for the fastest compression level: */
+	static const uint8_t zlib[2] = { 0x78, 0x01 };
+	uint8_t ihdr[13] = { 0 };
+
+	if (!crc_table[1])
+		init_crc_table();
+
+	*png = (struct png) {
+		.file = file,
+		.width = width,
+		.height = height,
+		.adler_a = 1,
+	};
+
+	png->row = malloc(1 + (size_t) width * 3);
+	if (!png->row)
+		return false;
+
+	if (fwrite(signature, 1, sizeof(signature), file) != sizeof(signature))
+		png->failed = true;
+
+	put_be32(ihdr, width);
+	put_be32(ihdr + 4, height);
+	ihdr[8] = 8;   /* bits per channel */
+	ihdr[9] = 2;   /* RGB */
+	png_begin_chunk(png, "IHDR", sizeof(ihdr));
+	png_write(png, ihdr, sizeof(ihdr));
+	png_end_chunk(png);
+
+	png_begin_chunk(png, "IDAT", sizeof(zlib));
+	png_write(png, zlib, sizeof(zlib));
+	png_end_chunk(png);
+
+	return !png->failed;
+}
+
+/* Writes the next rows of RGBA pixels, the stride of which is negative for
+ * bottom-up rows:
+ */
+bool png_write_rows(struct png *png, const uint8_t *rgba, ptrdiff_t stride, unsigned rows)
+{
+	size_t row_size = 1 + (size_t) png->width * 3;
+	size_t size = row_size * rows;
+	size_t blocks = (size + PNG_BLOCK_SIZE - 1) / PNG_BLOCK_SIZE;
+
+	if (size > 0x7fffffff - 5 * blocks)
+		return false;
+
+	png_begin_chunk(png, "IDAT", size + 5 * blocks);
+	png->remaining = size;
+	png->block = 0;
+
+	for (unsigned y = 0; y < rows; y++, rgba += stride) {
+		png->row[0] = 0;   /* no filter */
+		for (unsigned x = 0; x < png->width; x++)
+			memcpy(png->row + 1 + 3 * x, rgba + 4 * x, 3);
+		png_write_data(png, png->row, row_size);
+	}
+
+	png_end_chunk(png);
+
+	return !png->failed;
+}
+
+bool png_end(struct png *png)
+{
+	/* an empty final stored block, followed by the Adler-32 checksum: */
+	uint8_t end[9] = { 1, 0, 0, 0xff, 0xff };
+
+	put_be32(end + 5, png->adler_b << 16 | png->adler_a);
+	png_begin_chunk(png, "IDAT", sizeof(end));
+	png_write(png, end, sizeof(end));
+	png_end_chunk(png);
+
+	png_begin_chunk(png, "IEND", 0);
+	png_end_chunk(png);
+
+	free(png->row);
+	png->row = NULL;
+
+	return !png->failed;
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GLES3/gl3.h>
+
+#include "common.h"
+
+/* Module to render a still of a shader, of a size larger than the maximum
+ * size of the framebuffers, e.g. to print posters.
+ *
+ * The virtual viewport is split into tiles of the size of the framebuffer,
+ * each rendered with the offset of the tile added to the fragment coords,
+ * and read back into a band of tiles, which is written out as soon as all
+ * its tiles are rendered, from top to bottom, into a PNG or raw RGBA file,
+ * so that only a band is held in memory. The bands can be rendered by
+ * worker processes, and handed to a sink, like frames are.
+ */
+
+static struct {
+	unsigned width, height;            /* of the virtual viewport */
+	unsigned tile_width, tile_height;
+	unsigned columns, bands;
+	uint64_t time;                     /* in ns */
+
+	/* the bands rendered by this process: */
+	unsigned first, step, count;
+
+	FILE *file;
+	bool png;
+	struct png encoder;
+	unsigned written;                  /* bands written out */
+
+	uint8_t *band;
+	capture_sink sink;
+} poster;
+
+int init_poster(const struct options *options)
+{
+	double time = 0;
+	int n;
+
+	n = sscanf(options->poster, "%ux%u@%lf", &poster.width, &poster.height, &time);
+	if (n < 2 || !poster.width || !poster.height || time < 0) {
+		printf("invalid poster size: %s\n", options->poster);
+		return -1;
+	}
+
+	poster.tile_width = MIN2(options->width ? options->width : HEADLESS_WIDTH, poster.width);
+	poster.tile_height = MIN2(options->height ? options->height : HEADLESS_HEIGHT, poster.height);
+	poster.columns = (poster.width + poster.tile_width - 1) / poster.tile_width;
+	poster.bands = (poster.height + poster.tile_height - 1) / poster.tile_height;
+	poster.time = time * NSEC_PER_SEC;
+
+	if (!poster.step)
+		shard_poster(0, 1, poster.bands);
+
+	return 0;
+}
+
+/* the number of bands, and the size of the band buffers: */
+unsigned poster_bands(size_t *size)
+{
+	*size = (size_t) poster.width * poster.tile_height * 4;
+	return poster.bands;
+}
+
+void shard_poster(unsigned first, unsigned step, unsigned count)
+{
+	poster.first = first;
+	poster.step = step;
+	poster.count = count;
+}
+
+void poster_to_sink(capture_sink sink)
+{
+	poster.sink = sink;
+	poster.file = NULL;
+}
+
+int open_poster(const char *path)
+{
+	const char *ext = strrchr(path, '.');
+
+	/* the bands are handed to the sink instead: */
+	if (poster.sink)
+		return 0;
+
+	poster.file = fopen(path, "w");
+	if (!poster.file) {
+		printf("failed to open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	poster.png = ext && !strcmp(ext, ".png");
+	if (poster.png && !png_begin(&poster.encoder, poster.file, poster.width, poster.height)) {
+		printf("failed to write %s\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* the rows of the band, the last one being cropped to the viewport: */
+static unsigned band_rows(unsigned band)
+{
+	return MIN2(poster.tile_height, poster.height - band * poster.tile_height);
+}
+
+/* Write the band out, as bottom-up RGBA pixels, the bands being written in
+ * order, from the top:
+ */
+bool write_poster_band(const uint8_t *pixels, unsigned band)
+{
+	size_t stride = (size_t) poster.width * 4;
+	unsigned rows = band_rows(band);
+
+	if (band != poster.written++) {
+		printf("band %u written out of order\n", band);
+		return false;
+	}
+
+	if (poster.png)
+		return png_write_rows(&poster.encoder, pixels + (rows - 1) * stride,
+		                      -(ptrdiff_t) stride, rows);
+
+	for (unsigned y = rows; y-- > 0; ) {
+		if (fwrite(pixels + y * stride, stride, 1, poster.file) != 1)
+			return false;
+	}
+
+	return true;
+}
+
+int finish_poster(void)
+{
+	bool written = true;
+
+	if (!poster.file)
+		return 0;
+
+	if (poster.png)
+		written = png_end(&poster.encoder);
+	written = !fclose(poster.file) && written;
+	poster.file = NULL;
+
+	if (!written) {
+		printf("failed to write the poster\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Render the tiles of the band, reading them back into the band buffer: */
+static void render_band(const struct egl *egl, unsigned band, uint64_t start_time)
+{
+	unsigned rows = band_rows(band);
+	/* the offset of the tiles from the bottom of the viewport, which may
+	 * be negative for the last band, the bottom rows of which are not
+	 * read back:
+	 */
+	int y = (int) poster.height - (int) ((band + 1) * poster.tile_height);
+
+	glPixelStorei(GL_PACK_ROW_LENGTH, poster.width);
+
+	for (unsigned column = 0; column < poster.columns; column++) {
+		unsigned x = column * poster.tile_width;
+		unsigned columns = MIN2(poster.tile_width, poster.width - x);
+
+		set_shadertoy_tile(poster.width, poster.height, x, y);
+
+		uint64_t phase_start = profile_begin();
+		egl->draw(start_time, 0, start_time + poster.time);
+		profile_end(PHASE_DRAW, phase_start);
+
+		phase_start = profile_begin();
+		glReadPixels(0, poster.tile_height - rows, columns, rows,
+		             GL_RGBA, GL_UNSIGNED_BYTE, poster.band + (size_t) x * 4);
+		profile_end(PHASE_CAPTURE, phase_start);
+	}
+
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+}
+
+int render_poster(const struct gbm *gbm, const struct egl *egl)
+{
+	GLint max_dims[2];
+	size_t size;
+	uint64_t start_time, cur_time;
+	int ret = 0;
+
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_dims);
+	if (poster.tile_width > (unsigned) max_dims[0] || poster.tile_height > (unsigned) max_dims[1]) {
+		printf("the tiles of %ux%u exceed the maximum viewport size of %dx%d\n",
+		       poster.tile_width, poster.tile_height, max_dims[0], max_dims[1]);
+		return -1;
+	}
+
+	poster_bands(&size);
+	poster.band = malloc(size);
+	if (!poster.band) {
+		printf("failed to allocate the poster band\n");
+		return -1;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, egl->fbs[0].fb);
+	glViewport(0, 0, gbm->width, gbm->height);
+
+	start_time = get_time_ns();
+
+	for (unsigned i = 0; i < poster.count; i++) {
+		unsigned band = poster.first + i * poster.step;
+
+		render_band(egl, band, start_time);
+
+		if (poster.sink) {
+			poster.sink(poster.band, band);
+		} else if (!write_poster_band(poster.band, band)) {
+			printf("failed to write the poster\n");
+			ret = -1;
+			break;
+		}
+	}
+
+	if (finish_poster() < 0)
+		ret = -1;
+	free(poster.band);
+
+	cur_time = get_time_ns();
+	double secs = (cur_time - start_time) / (double) NSEC_PER_SEC;
+	double pixels = (double) poster.width * MIN2(poster.count * poster.tile_height, poster.height);
+	printf("Rendered %u band(s) of %u %ux%u tile(s) of a %ux%u poster in %f sec (%.1f Mpixels/s)\n",
+	       poster.count, poster.columns, poster.tile_width, poster.tile_height,
+	       poster.width, poster.height, secs, pixels / secs / 1e6);
+
+	dump_profile();
+
+	return ret;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+
+/* Module to measure the CPU time spent in each phase of the run loops,
+ * along with the GPU completion and the scanout of the frames.
+ *
+ * Call profile_begin() before the phase to measure, and profile_end() after
+ * it. When profiling is disabled, this boils down to testing a flag.
+ *
+ * The spans are written by the rendering thread only, into a ring that
+ * other threads can read from without locking, by loading the head with
+ * acquire semantics, while the per-phase totals are accumulated over the
+ * whole run. The ring is allocated upfront, and is large enough to hold
+ * about 10 minutes of spans at 60 fps, that are only written to the trace
+ * file upon exit, not to perturb the timing.
+ */
+
+#define PROFILE_SPANS (1 << 19)
+
+bool profiling;
+
+static const char *phase_names[] = {
+	[PHASE_DRAW]       = "draw",
+	[PHASE_FINISH]     = "finish",
+	[PHASE_SWAP]       = "swap",
+	[PHASE_LOCK_FRONT] = "lock_front",
+	[PHASE_FB_GET]     = "fb_get",
+	[PHASE_COMMIT]     = "commit",
+	[PHASE_WAIT]       = "wait",
+	[PHASE_RENDER]     = "onRender",
+	[PHASE_GPU]        = "gpu",
+	[PHASE_SCANOUT]    = "scanout",
+	[PHASE_CAPTURE]    = "capture",
+};
+
+/* the trace thread each phase is displayed on: */
+enum track {
+	TRACK_CPU = 1,
+	TRACK_GPU,
+	TRACK_DISPLAY,
+};
+
+static struct {
+	bool report;
+	const char *trace;
+
+	struct span *spans;
+	unsigned head;    /* total number of spans recorded */
+
+	struct {
+		uint64_t count;
+		uint64_t total;
+		uint64_t max;
+	} phases[PHASE_COUNT];
+} profile;
+
+void init_profile(bool report, const char *trace)
+{
+	if (!report && !trace)
+		return;
+
+	profile.spans = calloc(PROFILE_SPANS, sizeof(struct span));
+	if (!profile.spans) {
+		printf("failed to allocate the profiling buffer\n");
+		return;
+	}
+
+	profile.report = report;
+	profile.trace = trace;
+	profiling = true;
+}
+
+void record_phase(enum phase phase, uint64_t start, uint64_t end)
+{
+	unsigned head = profile.head;
+	struct span *span = &profile.spans[head % PROFILE_SPANS];
+	uint64_t duration = end - start;
+
+	span->phase = phase;
+	span->start = start;
+	span->end = end;
+
+	/* publish the span once it's written: */
+	__atomic_store_n(&profile.head, head + 1, __ATOMIC_RELEASE);
+
+	profile.phases[phase].count++;
+	profile.phases[phase].total += duration;
+	profile.phases[phase].max = MAX2(profile.phases[phase].max, duration);
+}
+
+static int compare_durations(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+static void write_trace(void)
+{
+	const double us = NSEC_PER_SEC / USEC_PER_SEC;
+	unsigned head = __atomic_load_n(&profile.head, __ATOMIC_ACQUIRE);
+	unsigned count = MIN2(head, PROFILE_SPANS);
+	FILE *file;
+
+	file = fopen(profile.trace, "w");
+	if (!file) {
+		printf("failed to open %s\n", profile.trace);
+		return;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"
+	        "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"glsl\"}},\n"
+	        "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"CPU\"}},\n"
+	        "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"GPU\"}},\n"
+	        "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"Display\"}}",
+	        TRACK_CPU, TRACK_GPU, TRACK_DISPLAY);
+
+	for (unsigned i = head - count; i != head; i++) {
+		const struct span *span = &profile.spans[i % PROFILE_SPANS];
+		enum track track = TRACK_CPU;
+
+		if (span->phase == PHASE_GPU)
+			track = TRACK_GPU;
+		else if (span->phase == PHASE_SCANOUT)
+			track = TRACK_DISPLAY;
+
+		fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+		        "\"pid\": 1, \"tid\": %d}",
+		        phase_names[span->phase], span->start / us,
+		        (span->end - span->start) / us, track);
+
+		/* the frame rate, as of the presentation of each frame: */
+		if (span->phase == PHASE_SCANOUT && span->end > span->start) {
+			fprintf(file, ",\n{\"name\": \"fps\", \"ph\": \"C\", \"ts\": %.3f, "
+			        "\"pid\": 1, \"args\": {\"fps\": %.3f}}",
+			        span->end / us, NSEC_PER_SEC / (double) (span->end - span->start));
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	printf("Wrote %u spans to %s\n", count, profile.trace);
+}
+
+static void report_profile(void)
+{
+	const double ms = NSEC_PER_SEC / MSEC_PER_SEC;
+	unsigned head = __atomic_load_n(&profile.head, __ATOMIC_ACQUIRE);
+	unsigned count = MIN2(head, PROFILE_SPANS);
+	uint64_t *durations;
+
+	durations = malloc(count * sizeof(*durations));
+	if (!durations)
+		return;
+
+	printf("%-12s %10s %10s %10s %10s %10s\n",
+	       "phase (ms)", "count", "mean", "p50", "p99", "max");
+
+	for (unsigned phase = 0; phase < PHASE_COUNT; phase++) {
+		uint64_t n = 0;
+
+		if (!profile.phases[phase].count)
+			continue;
+
+		/* the percentiles are computed over the recent spans: */
+		for (unsigned i = head - count; i != head; i++) {
+			const struct span *span = &profile.spans[i % PROFILE_SPANS];
+			if (span->phase == phase)
+				durations[n++] = span->end - span->start;
+		}
+		qsort(durations, n, sizeof(durations[0]), compare_durations);
+
+		printf("%-12s %10"PRIu64" %10.3f %10.3f %10.3f %10.3f\n",
+		       phase_names[phase], profile.phases[phase].count,
+		       profile.phases[phase].total / ms / profile.phases[phase].count,
+		       n ? durations[n / 2] / ms : 0,
+		       n ? durations[MIN2(n - 1, n * 99 / 100)] / ms : 0,
+		       profile.phases[phase].max / ms);
+	}
+
+	free(durations);
+}
+
+void dump_profile(void)
+{
+	if (!profiling)
+		return;
+
+	if (profile.report)
+		report_profile();
+
+	if (profile.trace)
+		write_trace();
+}
@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <GLES3/gl3.h>
+
+#include "common.h"
+
+/* Module to cache the binaries of the programs on disk, so that they don't
+ * have to be compiled again on the next runs, e.g. to shorten the time to
+ * the first frame of kiosks.
+ *
+ * The binaries are retrieved with glGetProgramBinary, of ES 3.0, or of the
+ * OES_get_program_binary extension on ES 2.0 drivers, and keyed by a hash
+ * of the sources of the shaders, of the renderer and version of the driver,
+ * and of the binary formats it supports, as they are only valid for the
+ * exact same driver. A binary that the driver rejects anyway, e.g. after an
+ * update of the driver that doesn't change its version, is removed, and the
+ * program is compiled instead.
+ *
+ * The binaries are stored under $XDG_CACHE_HOME/glsl, or ~/.cache/glsl,
+ * the least recently used ones being evicted once they exceed the size of
+ * the cache, a hit updating the modification time of the binary.
+ */
+
+#define PROGRAM_CACHE_SIZE (64 << 20)
+#define PROGRAM_CACHE_MAGIC "GLSLPROG"
+
+struct program_header {
+	char magic[8];
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+};
+
+static struct {
+	const struct egl *egl;
+	bool disabled;
+	char dir[PATH_MAX - NAME_MAX - 1];  /* to leave room for the names */
+	char path[PATH_MAX];  /* of the binary of the program being built */
+	uint64_t key;
+} cache;
+
+void init_program_cache(const struct egl *egl)
+{
+	cache.egl = egl;
+
+	if (!cache.disabled && (!egl->glGetProgramBinaryOES || !egl->glProgramBinaryOES)) {
+		printf("program binaries not supported, not caching them\n");
+		cache.disabled = true;
+	}
+}
+
+void disable_program_cache(void)
+{
+	cache.disabled = true;
+}
+
+/* Hint that the binary of the program is to be retrieved, which only ES 3.0
+ * supports, before linking it:
+ */
+void hint_program_binary(GLuint program)
+{
+	if (!cache.disabled && cache.egl && cache.egl->gles3)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+static uint64_t hash(uint64_t h, const char *s)
+{
+	/* FNV-1a, including the terminating null, to separate the strings: */
+	do {
+		h ^= (uint8_t) *s;
+		h *= 0x100000001b3ULL;
+	} while (*s++);
+
+	return h;
+}
+
+static int init_cache_dir(void)
+{
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	int n;
+
+	if (xdg && *xdg)
+		n = snprintf(cache.dir, sizeof(cache.dir), "%s/glsl", xdg);
+	else if (home && *home)
+		n = snprintf(cache.dir, sizeof(cache.dir), "%s/.cache/glsl", home);
+	else
+		return -1;
+	if (n >= (int) sizeof(cache.dir))
+		return -1;
+
+	/* create the parent directories as well: */
+	for (char *p = strchr(cache.dir + 1, '/'); ; p = strchr(p + 1, '/')) {
+		if (p)
+			*p = '\0';
+		if (mkdir(cache.dir, 0700) < 0 && errno != EEXIST) {
+			printf("failed to create %s: %s\n", cache.dir, strerror(errno));
+			return -1;
+		}
+		if (!p)
+			break;
+		*p = '/';
+	}
+
+	return 0;
+}
+
+static bool cache_enabled(void)
+{
+	GLint formats = 0;
+
+	if (cache.disabled || !cache.egl)
+		return false;
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (formats <= 0 || (!cache.dir[0] && init_cache_dir() < 0)) {
+		cache.disabled = true;
+		return false;
+	}
+
+	return true;
+}
+
+static uint64_t program_key(const char *vs_src, const char *fs_src)
+{
+	GLint count = 0, *formats;
+	uint64_t h = 0xcbf29ce484222325ULL;
+	char format[16];
+
+	h = hash(h, vs_src);
+	h = hash(h, fs_src);
+	h = hash(h, (const char *) glGetString(GL_RENDERER));
+	h = hash(h, (const char *) glGetString(GL_VERSION));
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+	formats = calloc(count, sizeof(*formats));
+	if (formats) {
+		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats);
+		for (GLint i = 0; i < count; i++) {
+			snprintf(format, sizeof(format), "%x", formats[i]);
+			h = hash(h, format);
+		}
+		free(formats);
+	}
+
+	return h;
+}
+
+/* Load the program from its cached binary, returning -1 if there's none, or
+ * if it's rejected, for the program to be built from its sources:
+ */
+int load_program_binary(const char *vs_src, const char *fs_src)
+{
+	struct program_header header;
+	struct stat st;
+	void *binary = NULL;
+	GLint status = 0;
+	GLuint program = 0;
+	FILE *file;
+
+	cache.path[0] = '\0';
+	if (!cache_enabled())
+		return -1;
+
+	cache.key = program_key(vs_src, fs_src);
+	snprintf(cache.path, sizeof(cache.path), "%s/%016llx.bin", cache.dir,
+	         (unsigned long long) cache.key);
+
+	file = fopen(cache.path, "r");
+	if (!file)
+		return -1;
+
+	uint64_t start = get_time_ns();
+
+	/* the length is bounded by the file size, not to trust a corrupted one: */
+	if (!fstat(fileno(file), &st) &&
+	    fread(&header, sizeof(header), 1, file) == 1 &&
+	    !memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) &&
+	    header.key == cache.key && header.length &&
+	    header.length <= st.st_size - sizeof(header) &&
+	    (binary = malloc(header.length)) &&
+	    fread(binary, header.length, 1, file) == 1) {
+		program = glCreateProgram();
+		cache.egl->glProgramBinaryOES(program, header.format, binary, header.length);
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (!status)
+			glDeleteProgram(program);
+	}
+	free(binary);
+	fclose(file);
+
+	if (!status) {
+		/* e.g. of an unsupported format: */
+		glGetError();
+		printf("discarding the rejected program binary %s\n", cache.path);
+		unlink(cache.path);
+		return -1;
+	}
+
+	build_times.compile_vs = 0;
+	build_times.compile_fs = 0;
+	build_times.link = get_time_ns() - start;
+
+	/* the binary is the most recently used one: */
+	utimensat(AT_FDCWD, cache.path, NULL, 0);
+
+	printf("Loaded the program binary from %s\n", cache.path);
+
+	return program;
+}
+
+struct cache_entry {
+	char name[NAME_MAX + 1];
+	off_t size;
+	struct timespec mtime;
+};
+
+static int compare_mtimes(const void *a, const void *b)
+{
+	const struct cache_entry *x = a, *y = b;
+
+	if (x->mtime.tv_sec != y->mtime.tv_sec)
+		return (x->mtime.tv_sec > y->mtime.tv_sec) - (x->mtime.tv_sec < y->mtime.tv_sec);
+	return (x->mtime.tv_nsec > y->mtime.tv_nsec) - (x->mtime.tv_nsec < y->mtime.tv_nsec);
+}
+
+/* Evict the least recently used binaries, beyond the size of the cache: */
+static void prune_cache(void)
+{
+	struct cache_entry *entries = NULL;
+	unsigned count = 0, capacity = 0;
+	uint64_t total = 0;
+	struct dirent *dirent;
+	char path[PATH_MAX];
+	DIR *dir;
+
+	dir = opendir(cache.dir);
+	if (!dir)
+		return;
+
+	while ((dirent = readdir(dir))) {
+		const char *ext = strrchr(dirent->d_name, '.');
+		struct stat st;
+
+		if (!ext || strcmp(ext, ".bin"))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", cache.dir, dirent->d_name);
+		if (stat(path, &st) < 0)
+			continue;
+
+		if (count == capacity) {
+			struct cache_entry *grown;
+			capacity = capacity ? capacity * 2 : 64;
+			grown = realloc(entries, capacity * sizeof(*entries));
+			if (!grown)
+				break;
+			entries = grown;
+		}
+		strcpy(entries[count].name, dirent->d_name);
+		entries[count].size = st.st_size;
+		entries[count].mtime = st.st_mtim;
+		total += st.st_size;
+		count++;
+	}
+	closedir(dir);
+
+	qsort(entries, count, sizeof(*entries), compare_mtimes);
+
+	for (unsigned i = 0; i < count && total > PROGRAM_CACHE_SIZE; i++) {
+		snprintf(path, sizeof(path), "%s/%s", cache.dir, entries[i].name);
+		if (!unlink(path))
+			total -= entries[i].size;
+	}
+
+	free(entries);
+}
+
+/* Store the binary of the program built from the sources given to the last
+ * load_program_binary() call:
+ */
+void save_program_binary(GLuint program)
+{
+	struct program_header header = {
+		.key = cache.key,
+	};
+	char path[PATH_MAX + 8];
+	GLint length = 0;
+	GLenum format;
+	void *binary;
+	FILE *file;
+	bool written;
+
+	if (cache.disabled || !cache.path[0])
+		return;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	binary = malloc(length);
+	if (!binary)
+		return;
+
+	cache.egl->glGetProgramBinaryOES(program, length, &length, &format, binary);
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+	header.format = format;
+	header.length = length;
+
+	/* written aside first, not to leave a partial binary behind: */
+	snprintf(path, sizeof(path), "%s.%d", cache.path, getpid());
+	file = fopen(path, "w");
+	if (!file) {
+		printf("failed to open %s: %s\n", path, strerror(errno));
+		free(binary);
+		return;
+	}
+	written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+	          fwrite(binary, length, 1, file) == 1;
+	written = !fclose(file) && written;
+	free(binary);
+
+	if (!written || rename(path, cache.path) < 0) {
+		printf("failed to write %s\n", cache.path);
+		unlink(path);
+		return;
+	}
+
+	prune_cache();
+}
@@ -23,21 +23,74 @@
 
 #define _GNU_SOURCE
 
+#include <dirent.h>
 #include <err.h>
+#include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <regex.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <GLES3/gl3.h>
 
 #include "common.h"
 
-GLint iTime, iFrame;
+GLint iTime, iTimeDelta, iFrameRate, iFrame, iDate;
+GLint iResolution, iTileOffset;
+
+/* iDate is computed from iTime, starting from the current date, or from a
+ * fixed one in fixed timing, so that the same frames are rendered on every
+ * run:
+ */
+#define FIXED_DATE 946684800  /* 2000-01-01T00:00:00Z */
+static time_t date_origin;
+static bool fixed_timing;
+
+/* whether to print the time spent building the program, on startup: */
+static bool build_info;
+
+/* the size of the framebuffers: */
+static struct {
+	unsigned width, height;
+} resolution;
+
+/* the viewport, and the offset into it, of the tile being rendered: */
+static struct {
+	unsigned width, height;
+	int x, y;
+} tile;
+
+/* the state of the program built in the background, if any: */
+#define BUILD_PENDING 0
+#define BUILD_FAILED -1
+#define BUILD_NO_CONTEXT -2  /* to build the program synchronously instead */
+
+static struct {
+	const struct egl *egl;
+	const char *shader;
+	GLuint placeholder;       /* while the program is being built */
+	bool failed;
+	uint64_t start;
+	unsigned frames;          /* drawn with the placeholder */
+
+	/* with KHR_parallel_shader_compile: */
+	GLuint program;
+	uint64_t build_start;
+
+	/* otherwise, the program built by the thread, once done: */
+	EGLConfig config;
+	pthread_t thread;
+	bool threaded;
+	int built;
+} async;
+
+static bool switch_program(void);
 
 static const char *shadertoy_vs_tmpl_100 =
 		"// version (default: 1.10)              \n"
@@ -73,16 +126,19 @@ static const char *shadertoy_fs_tmpl_100 =
 		"                                                                                     \n"
 		"uniform vec3      iResolution;           // viewport resolution (in pixels)          \n"
 		"uniform float     iTime;                 // shader playback time (in seconds)        \n"
+		"uniform float     iTimeDelta;            // render time (in seconds)                 \n"
+		"uniform float     iFrameRate;            // shader frame rate                        \n"
 		"uniform int       iFrame;                // current frame number                     \n"
 		"uniform vec4      iMouse;                // mouse pixel coords                       \n"
 		"uniform vec4      iDate;                 // (year, month, day, time in seconds)      \n"
+		"uniform vec2      iTileOffset;           // tile offset in the viewport (in pixels)  \n"
 		"                                                                                     \n"
 		"// Shader body                                                                       \n"
 		"%s                                                                                   \n"
 		"                                                                                     \n"
 		"void main()                                                                          \n"
 		"{                                                                                    \n"
-		"    mainImage(gl_FragColor, gl_FragCoord.xy);                                        \n"
+		"    mainImage(gl_FragColor, gl_FragCoord.xy + iTileOffset);                          \n"
 		"}                                                                                    \n";
 
 static const char *shadertoy_fs_tmpl_300 =
@@ -99,16 +155,19 @@ static const char *shadertoy_fs_tmpl_300 =
 		"                                                                                     \n"
 		"uniform vec3      iResolution;           // viewport resolution (in pixels)          \n"
 		"uniform float     iTime;                 // shader playback time (in seconds)        \n"
+		"uniform float     iTimeDelta;            // render time (in seconds)                 \n"
+		"uniform float     iFrameRate;            // shader frame rate                        \n"
 		"uniform int       iFrame;                // current frame number                     \n"
 		"uniform vec4      iMouse;                // mouse pixel coords                       \n"
 		"uniform vec4      iDate;                 // (year, month, day, time in seconds)      \n"
+		"uniform vec2      iTileOffset;           // tile offset in the viewport (in pixels)  \n"
 		"                                                                                     \n"
 		"// Shader body                                                                       \n"
 		"%s                                                                                   \n"
 		"                                                                                     \n"
 		"void main()                                                                          \n"
 		"{                                                                                    \n"
-		"    mainImage(fragColor, gl_FragCoord.xy);                                           \n"
+		"    mainImage(fragColor, gl_FragCoord.xy + iTileOffset);                             \n"
 		"}                                                                                    \n";
 
 static const GLfloat vertices[] = {
@@ -223,78 +282,183 @@ void onRender(onRenderCallback callback) {
 	addCallback(&onRenderCallbacks, (void (*)) callback);
 }
 
-static void draw_shadertoy(uint64_t start_time, unsigned frame) {
-	float time = ((float) (get_time_ns() - start_time)) / NSEC_PER_SEC;
+static void draw_shadertoy(uint64_t start_time, unsigned frame, uint64_t present_time) {
+	static float last_time;
+
+	/* render the same frame as the other instances of the wall: */
+	sync_wall(&frame, &start_time, &present_time, &date_origin);
+
+	if (!present_time) {
+		present_time = get_time_ns();
+	}
+	float time = ((float) ((int64_t) (present_time - start_time))) / NSEC_PER_SEC;
+	float delta = frame > 0 && time > last_time ? time - last_time : 0;
+	/* the frames may not be rendered in sequence, e.g. when sharded: */
+	if (fixed_timing) {
+		delta = frame > 0 ? time / frame : 0;
+	}
+	last_time = time;
+
+	if (!switch_program()) {
+		async.frames++;
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+		return;
+	}
 
 	glUniform1f(iTime, time);
-	// Replace the above to input elapsed time relative to 60 FPS
-	// glUniform1f(iTime, (GLfloat) frame / 60.0f);
+	glUniform1f(iTimeDelta, delta);
+	glUniform1f(iFrameRate, delta > 0 ? 1 / delta : 0);
 	glUniform1ui(iFrame, frame);
 
+	if (iDate >= 0) {
+		time_t date = date_origin + (time_t) time;
+		struct tm tm;
+		if (fixed_timing)
+			gmtime_r(&date, &tm);
+		else
+			localtime_r(&date, &tm);
+		glUniform4f(iDate, tm.tm_year + 1900, tm.tm_mon, tm.tm_mday,
+		            tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec + (time - (time_t) time));
+	}
+
+	uint64_t render_start = profile_begin();
 	for (uint i = 0; i < onRenderCallbacks.length; i++) {
 		((onRenderCallback) onRenderCallbacks.callbacks[i])(frame, time);
 	}
+	profile_end(PHASE_RENDER, render_start);
 
 	start_perfcntrs();
+	start_gpu_timing();
 
 	glDrawArrays(GL_TRIANGLES, 0, 6);
 
+	end_gpu_timing();
 	end_perfcntrs();
 }
 
-int init_shadertoy(const struct gbm *gbm, struct egl *egl, const char *file) {
-	int ret;
-	char *shadertoy_vs, *shadertoy_fs;
-	GLuint program, vbo;
-	GLint iResolution;
+/* Render a tile of a larger virtual viewport, e.g. one that exceeds the
+ * maximum size of the framebuffers, of the given size, and at the given
+ * offset from its bottom left corner:
+ */
+void set_shadertoy_tile(unsigned width, unsigned height, int x, int y) {
+	tile.width = width;
+	tile.height = height;
+	tile.x = x;
+	tile.y = y;
+
+	/* or once the program is built: */
+	if (!async.placeholder) {
+		glUniform3f(iResolution, width, height, 0);
+		glUniform2f(iTileOffset, x, y);
+	}
+}
 
-	const char *shader = load_shader(file);
+static struct {
+	char *directive;
+	bool is_glsl_3;
+} version;
+
+static int init_version(void) {
+	const char *v = glsl_version();
 
-	const char *version = glsl_version();
-	if (strlen(version) > 0) {
+	if (strlen(v) > 0) {
 		char *invalid;
-		long v = strtol(version, &invalid, 10);
-		if (invalid == version) {
+		long n = strtol(v, &invalid, 10);
+		if (invalid == v) {
 			printf("failed to parse detected GLSL version: %s\n", invalid);
 			return -1;
 		}
-		char *version_directive;
-		asprintf(&version_directive, "#version %s", version);
-		printf("Using GLSL version directive: %s\n", version_directive);
+		asprintf(&version.directive, "#version %s", v);
+		printf("Using GLSL version directive: %s\n", version.directive);
 
-		bool is_glsl_3 = v >= 300;
-		asprintf(&shadertoy_vs, is_glsl_3 ? shadertoy_vs_tmpl_300 : shadertoy_vs_tmpl_100, version_directive);
-		asprintf(&shadertoy_fs, is_glsl_3 ? shadertoy_fs_tmpl_300 : shadertoy_fs_tmpl_100, version_directive, shader);
+		version.is_glsl_3 = n >= 300;
 	} else {
-		asprintf(&shadertoy_vs, shadertoy_vs_tmpl_100, version);
-		asprintf(&shadertoy_fs, shadertoy_fs_tmpl_100, version, shader);
+		version.directive = strdup(v);
 	}
 
-	ret = create_program(shadertoy_vs, shadertoy_fs);
-	if (ret < 0) {
+	return 0;
+}
+
+static void shadertoy_sources(const char *shader, char **vs, char **fs) {
+	asprintf(vs, version.is_glsl_3 ? shadertoy_vs_tmpl_300 : shadertoy_vs_tmpl_100,
+	         version.directive);
+	asprintf(fs, version.is_glsl_3 ? shadertoy_fs_tmpl_300 : shadertoy_fs_tmpl_100,
+	         version.directive, shader);
+}
+
+/* Build the program from the shadertoy templates, timing its stages: */
+static int build_shadertoy(const char *shader) {
+	char *shadertoy_vs, *shadertoy_fs;
+	int ret, program;
+
+	shadertoy_sources(shader, &shadertoy_vs, &shadertoy_fs);
+
+	program = load_program_binary(shadertoy_vs, shadertoy_fs);
+	if (program >= 0) {
+		free(shadertoy_vs);
+		free(shadertoy_fs);
+		return program;
+	}
+
+	program = create_program(shadertoy_vs, shadertoy_fs);
+	free(shadertoy_vs);
+	free(shadertoy_fs);
+	if (program < 0) {
 		printf("failed to create program\n");
 		return -1;
 	}
 
-	program = ret;
+	hint_program_binary(program);
 
 	ret = link_program(program);
 	if (ret) {
 		printf("failed to link program\n");
+		glDeleteProgram(program);
 		return -1;
 	}
 
-	glViewport(0, 0, gbm->width, gbm->height);
-	glUseProgram(program);
+	save_program_binary(program);
 
-	iTime = glGetUniformLocation(program, "iTime");
-	iFrame = glGetUniformLocation(program, "iFrame");
-	iResolution = glGetUniformLocation(program, "iResolution");
-	glUniform3f(iResolution, gbm->width, gbm->height, 0);
+	return program;
+}
 
-	for (uint i = 0; i < onInitCallbacks.length; i++) {
-		((onInitCallback) onInitCallbacks.callbacks[i])(program, gbm->width, gbm->height);
-	}
+/* Draw with the current program once, into an offscreen target, as lazy
+ * drivers may defer the build of the program until its first use:
+ */
+static void first_draw(void) {
+	GLint viewport[4], fb;
+	GLuint offscreen_fb, rb;
+	uint64_t start = get_time_ns();
+
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fb);
+
+	glGenRenderbuffers(1, &rb);
+	glBindRenderbuffer(GL_RENDERBUFFER, rb);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+	glGenFramebuffers(1, &offscreen_fb);
+	glBindFramebuffer(GL_FRAMEBUFFER, offscreen_fb);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rb);
+
+	glViewport(0, 0, 1, 1);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glFinish();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fb);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glDeleteFramebuffers(1, &offscreen_fb);
+	glDeleteRenderbuffers(1, &rb);
+
+	build_times.first_draw = get_time_ns() - start;
+}
+
+static double build_time(void) {
+	return (build_times.compile_vs + build_times.compile_fs + build_times.link + build_times.first_draw) /
+	       (double) (NSEC_PER_SEC / MSEC_PER_SEC);
+}
+
+static void init_vertices(void) {
+	GLuint vbo;
 
 	glGenBuffers(1, &vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -302,8 +466,460 @@ int init_shadertoy(const struct gbm *gbm, struct egl *egl, const char *file) {
 	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), &vertices[0]);
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (const GLvoid *) (intptr_t) 0);
 	glEnableVertexAttribArray(0);
+}
+
+/* Use the program for the next frames, and call the init callbacks: */
+static void use_program(int program) {
+	glUseProgram(program);
+
+	iTime = glGetUniformLocation(program, "iTime");
+	iTimeDelta = glGetUniformLocation(program, "iTimeDelta");
+	iFrameRate = glGetUniformLocation(program, "iFrameRate");
+	iFrame = glGetUniformLocation(program, "iFrame");
+	iDate = glGetUniformLocation(program, "iDate");
+	iResolution = glGetUniformLocation(program, "iResolution");
+	iTileOffset = glGetUniformLocation(program, "iTileOffset");
+	glUniform3f(iResolution, tile.width, tile.height, 0);
+	glUniform2f(iTileOffset, tile.x, tile.y);
+
+	for (uint i = 0; i < onInitCallbacks.length; i++) {
+		((onInitCallback) onInitCallbacks.callbacks[i])(program, resolution.width, resolution.height);
+	}
+}
+
+static void print_build_times(void) {
+	const double ms = NSEC_PER_SEC / MSEC_PER_SEC;
+
+	if (!build_info)
+		return;
+
+	printf("Built the program in %.3f ms: vertex shader %.3f ms, fragment shader %.3f ms, "
+	       "link %.3f ms, first draw %.3f ms\n", build_time(),
+	       build_times.compile_vs / ms, build_times.compile_fs / ms,
+	       build_times.link / ms, build_times.first_draw / ms);
+}
+
+/* Build the program in the background, with the parallel compilation of
+ * the driver if supported, or in a thread with a shared context otherwise,
+ * drawing a placeholder in the meantime, from the first frame on.
+ */
+
+static const char *placeholder_vs =
+		"attribute vec3 position;                \n"
+		"                                        \n"
+		"void main()                             \n"
+		"{                                       \n"
+		"    gl_Position = vec4(position, 1.0);  \n"
+		"}                                       \n";
+
+static const char *placeholder_fs =
+		"precision mediump float;                \n"
+		"                                        \n"
+		"void main()                             \n"
+		"{                                       \n"
+		"    gl_FragColor = vec4(vec3(0.1), 1.0);\n"
+		"}                                       \n";
+
+static void *build_thread(void *arg) {
+	const struct egl *egl = async.egl;
+	EGLSurface surface = EGL_NO_SURFACE;
+	EGLContext context = arg;
+	int program = BUILD_NO_CONTEXT;
+
+	if (!eglMakeCurrent(egl->display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		/* a context can't be made current without surface: */
+		static const EGLint pbuffer_attribs[] = {
+			EGL_WIDTH, 1,
+			EGL_HEIGHT, 1,
+			EGL_NONE
+		};
+		surface = eglCreatePbufferSurface(egl->display, async.config, pbuffer_attribs);
+		if (surface == EGL_NO_SURFACE ||
+		    !eglMakeCurrent(egl->display, surface, surface, context))
+			goto out;
+	}
+
+	program = build_shadertoy(async.shader);
+	if (program > 0) {
+		glUseProgram(program);
+		init_vertices();
+		first_draw();
+		glUseProgram(0);
+	}
+	/* for the program to be complete, when used from the other context: */
+	glFinish();
+
+	eglMakeCurrent(egl->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+out:
+	if (surface != EGL_NO_SURFACE)
+		eglDestroySurface(egl->display, surface);
+	eglDestroyContext(egl->display, context);
+
+	__atomic_store_n(&async.built, program > 0 ? program : program == BUILD_NO_CONTEXT ?
+	                 BUILD_NO_CONTEXT : BUILD_FAILED, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+static void join_build_thread(void) {
+	if (async.threaded) {
+		pthread_join(async.thread, NULL);
+		async.threaded = false;
+	}
+}
+
+static void print_info_log(GLuint object, bool program) {
+	GLint length = 0;
+	char *log;
+
+	if (program)
+		glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+	else
+		glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+	if (length <= 1 || !(log = malloc(length)))
+		return;
+
+	if (program)
+		glGetProgramInfoLog(object, length, NULL, log);
+	else
+		glGetShaderInfoLog(object, length, NULL, log);
+	printf("%s%s", log, log[strlen(log) - 1] == '\n' ? "" : "\n");
+	free(log);
+}
+
+static void start_parallel_build(const char *vs_src, const char *fs_src) {
+	GLuint shaders[2];
+
+	/* none of the calls wait for the compilation to complete: */
+	async.build_start = get_time_ns();
+	shaders[0] = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(shaders[0], 1, &vs_src, NULL);
+	glCompileShader(shaders[0]);
+	shaders[1] = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(shaders[1], 1, &fs_src, NULL);
+	glCompileShader(shaders[1]);
+
+	async.program = glCreateProgram();
+	for (unsigned i = 0; i < 2; i++) {
+		glAttachShader(async.program, shaders[i]);
+		glDeleteShader(shaders[i]);
+	}
+	hint_program_binary(async.program);
+	glLinkProgram(async.program);
+}
+
+static int finish_parallel_build(void) {
+	GLuint shaders[2];
+	GLsizei count = 0;
+	GLint status;
+
+	glGetProgramiv(async.program, GL_LINK_STATUS, &status);
+	if (status) {
+		save_program_binary(async.program);
+		return async.program;
+	}
+
+	printf("program linking failed!:\n");
+	glGetAttachedShaders(async.program, 2, &count, shaders);
+	for (GLsizei i = 0; i < count; i++)
+		print_info_log(shaders[i], false);
+	print_info_log(async.program, true);
+	glDeleteProgram(async.program);
+
+	return BUILD_FAILED;
+}
+
+/* The config of the shared context of the thread, that must support pbuffer
+ * surfaces, for it to be made current without surfaceless contexts, unlike
+ * the config for the window surfaces of the display backends:
+ */
+static EGLConfig pbuffer_config(const struct egl *egl) {
+	static const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RED_SIZE, 1,
+		EGL_GREEN_SIZE, 1,
+		EGL_BLUE_SIZE, 1,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+		EGL_NONE
+	};
+	EGLint surface_type = 0, count = 0;
+	EGLConfig config;
+
+	eglGetConfigAttrib(egl->display, egl->config, EGL_SURFACE_TYPE, &surface_type);
+	if (surface_type & EGL_PBUFFER_BIT)
+		return egl->config;
+
+	if (eglChooseConfig(egl->display, config_attribs, &config, 1, &count) && count)
+		return config;
+
+	return egl->config;
+}
+
+static int start_async_build(const struct egl *egl, const char *shader) {
+	const char *gl_exts = (const char *) glGetString(GL_EXTENSIONS);
+	char *shadertoy_vs, *shadertoy_fs;
+	int program;
+
+	async.egl = egl;
+	async.shader = shader;
+	async.start = get_time_ns();
+
+	program = create_program(placeholder_vs, placeholder_fs);
+	if (program < 0) {
+		return -1;
+	}
+	glBindAttribLocation(program, 0, "position");
+	if (link_program(program)) {
+		return -1;
+	}
+	async.placeholder = program;
+	glUseProgram(program);
+
+	/* a cached binary is loaded quickly enough, not to be built at all: */
+	shadertoy_sources(shader, &shadertoy_vs, &shadertoy_fs);
+	program = load_program_binary(shadertoy_vs, shadertoy_fs);
+	if (program >= 0) {
+		free(shadertoy_vs);
+		free(shadertoy_fs);
+		glDeleteProgram(async.placeholder);
+		async.placeholder = 0;
+		use_program(program);
+		first_draw();
+		print_build_times();
+		return 0;
+	}
+
+	if (gl_exts && strstr(gl_exts, "GL_KHR_parallel_shader_compile")) {
+		start_parallel_build(shadertoy_vs, shadertoy_fs);
+		free(shadertoy_vs);
+		free(shadertoy_fs);
+		return 0;
+	}
+	free(shadertoy_vs);
+	free(shadertoy_fs);
+
+	static const EGLint context_attribs[] = {
+		EGL_CONTEXT_CLIENT_VERSION, 2,
+		EGL_NONE
+	};
+	async.config = pbuffer_config(egl);
+	EGLContext context = eglCreateContext(egl->display, async.config, egl->context,
+	                                      context_attribs);
+	if (context == EGL_NO_CONTEXT ||
+	    pthread_create(&async.thread, NULL, build_thread, context)) {
+		printf("failed to start the build of the program, building it on the first frame\n");
+		if (context != EGL_NO_CONTEXT)
+			eglDestroyContext(egl->display, context);
+		async.built = BUILD_NO_CONTEXT;
+	} else {
+		async.threaded = true;
+	}
+
+	return 0;
+}
+
+/* Switch to the program once built, returning false as long as the
+ * placeholder is to be drawn instead:
+ */
+static bool switch_program(void) {
+	int program;
+
+	if (!async.placeholder)
+		return true;
+	if (async.failed)
+		return false;
+
+	if (async.program) {
+		GLint done = 0;
+
+		glGetProgramiv(async.program, GL_COMPLETION_STATUS_KHR, &done);
+		if (!done)
+			return false;
+		program = finish_parallel_build();
+		if (program > 0) {
+			/* the stages are built in parallel, the whole build,
+			 * until it's found complete, is accounted as the link:
+			 */
+			build_times.compile_vs = 0;
+			build_times.compile_fs = 0;
+			build_times.link = get_time_ns() - async.build_start;
+
+			/* for the lazy drivers to finish the build before it's used: */
+			glUseProgram(program);
+			first_draw();
+			print_build_times();
+		}
+	} else {
+		program = __atomic_load_n(&async.built, __ATOMIC_ACQUIRE);
+		if (program == BUILD_PENDING)
+			return false;
+		join_build_thread();
+		if (program == BUILD_NO_CONTEXT) {
+			program = build_shadertoy(async.shader);
+			if (program > 0)
+				first_draw();
+		}
+		if (program > 0)
+			print_build_times();
+	}
+
+	if (program < 0) {
+		printf("failed to build the program, keeping the placeholder\n");
+		async.failed = true;
+		return false;
+	}
+
+	glDeleteProgram(async.placeholder);
+	async.placeholder = 0;
+	use_program(program);
+
+	printf("Switched from the placeholder to the program after %.3f ms and %u frame(s)\n",
+	       (get_time_ns() - async.start) / (double) (NSEC_PER_SEC / MSEC_PER_SEC), async.frames);
+
+	return true;
+}
+
+/* Not to exit while the thread is still building the program, e.g. when
+ * rendering less frames than it takes:
+ */
+void finish_shadertoy(void) {
+	join_build_thread();
+}
+
+int init_shadertoy(const struct gbm *gbm, struct egl *egl, const char *file,
+                   enum timing timing, bool async_build, bool print_build) {
+	int program;
+
+	const char *shader = load_shader(file);
+
+	if (init_version() < 0) {
+		return -1;
+	}
+
+	resolution.width = gbm->width;
+	resolution.height = gbm->height;
+	set_shadertoy_tile(gbm->width, gbm->height, 0, 0);
+	build_info = print_build;
+
+	glViewport(0, 0, gbm->width, gbm->height);
+	init_vertices();
+
+	if (async_build) {
+		if (start_async_build(egl, shader) < 0) {
+			return -1;
+		}
+	} else {
+		program = build_shadertoy(shader);
+		if (program < 0) {
+			return -1;
+		}
+
+		use_program(program);
+
+		/* the first draw is only timed, not to delay the startup otherwise: */
+		if (build_info) {
+			first_draw();
+			print_build_times();
+		}
+	}
+
+	fixed_timing = timing == TIMING_FIXED;
+	date_origin = fixed_timing ? FIXED_DATE : time(NULL);
 
 	egl->draw = draw_shadertoy;
 
 	return 0;
 }
+
+static int shader_file(const struct dirent *entry) {
+	const char *ext = strrchr(entry->d_name, '.');
+
+	return ext && !strcmp(ext, ".glsl");
+}
+
+/* Build the program of the shader, twice, the second build being expected
+ * to hit the shader cache of the driver, if any, returning the time of the
+ * first build, or a negative value if it fails:
+ */
+static int time_build(const char *file, struct build_times *cold, double *warm) {
+	const char *shader = load_shader(file);
+	int program;
+
+	for (unsigned i = 0; i < 2; i++) {
+		program = build_shadertoy(shader);
+		if (program < 0) {
+			return -1;
+		}
+
+		glUseProgram(program);
+		first_draw();
+		glUseProgram(0);
+		glDeleteProgram(program);
+
+		if (i == 0)
+			*cold = build_times;
+	}
+	*warm = build_time();
+
+	return 0;
+}
+
+/* Report the build times of the shader, or of all the shaders of the
+ * directory:
+ */
+int report_build_times(const char *path) {
+	const double ms = NSEC_PER_SEC / MSEC_PER_SEC;
+	struct dirent **entries = NULL;
+	struct stat statbuf;
+	int count = 1, failed = 0;
+
+	if (stat(path, &statbuf) < 0) {
+		printf("could not stat '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if (S_ISDIR(statbuf.st_mode)) {
+		count = scandir(path, &entries, shader_file, alphasort);
+		if (count < 0) {
+			printf("could not scan '%s': %s\n", path, strerror(errno));
+			return -1;
+		}
+	}
+
+	if (init_version() < 0) {
+		return -1;
+	}
+	init_vertices();
+
+	/* time the builds, not the loads of the binaries: */
+	disable_program_cache();
+
+	printf("%-40s %10s %10s %10s %10s %10s %10s\n", "shader (ms)",
+	       "vertex", "fragment", "link", "draw", "total", "rebuild");
+
+	for (int i = 0; i < count; i++) {
+		struct build_times cold;
+		double warm;
+		char *file;
+
+		if (entries) {
+			asprintf(&file, "%s/%s", path, entries[i]->d_name);
+			free(entries[i]);
+		} else {
+			file = strdup(path);
+		}
+
+		if (time_build(file, &cold, &warm) < 0) {
+			printf("%-40s failed\n", basename(file));
+			failed++;
+		} else {
+			printf("%-40s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", basename(file),
+			       cold.compile_vs / ms, cold.compile_fs / ms, cold.link / ms, cold.first_draw / ms,
+			       (cold.compile_vs + cold.compile_fs + cold.link + cold.first_draw) / ms, warm);
+		}
+		free(file);
+	}
+	free(entries);
+
+	return failed ? -1 : 0;
+}
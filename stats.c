@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "glsl.h"
+
+/* Module to collect the frame times, i.e. the intervals between the
+ * presentation of consecutive frames, as reported by the page flip events.
+ *
+ * The frame times of the last STATS_HISTORY frames are kept in a ring, from
+ * which the percentiles are computed, while the histogram, the maximum and
+ * the missed deadlines are accumulated over the whole run. The statistics
+ * are updated from the rendering thread, and can be queried concurrently
+ * with get_stats().
+ */
+
+#define STATS_HISTORY 1024
+
+static struct {
+	pthread_mutex_t lock;
+	enum stats_format format;
+
+	uint32_t frame_times[STATS_HISTORY];  /* in microseconds */
+	unsigned idx;
+
+	uint64_t frames;
+	uint64_t missed;
+	uint32_t max;
+	uint64_t histogram[STATS_BUCKETS];
+
+	uint64_t last_time;
+	unsigned last_sequence;
+} stats = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+void init_stats(enum stats_format format)
+{
+	stats.format = format;
+}
+
+void stats_frame(unsigned sequence, uint64_t time)
+{
+	pthread_mutex_lock(&stats.lock);
+
+	/* the first frame has no previous one to measure from: */
+	if (stats.last_time && time > stats.last_time) {
+		uint32_t frame_time = (time - stats.last_time) / (NSEC_PER_SEC / USEC_PER_SEC);
+
+		stats.frame_times[stats.idx] = frame_time;
+		stats.idx = (stats.idx + 1) % STATS_HISTORY;
+
+		stats.frames++;
+		stats.max = MAX2(stats.max, frame_time);
+		stats.histogram[MIN2(frame_time / (USEC_PER_SEC / MSEC_PER_SEC), STATS_BUCKETS - 1)]++;
+
+		/* the previous frame was kept on screen for more than
+		 * one refresh cycle:
+		 */
+		if (sequence - stats.last_sequence > 1)
+			stats.missed++;
+	}
+
+	stats.last_time = time;
+	stats.last_sequence = sequence;
+
+	pthread_mutex_unlock(&stats.lock);
+}
+
+static int compare_frame_times(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+static double percentile(const uint32_t *sorted, unsigned count, unsigned p)
+{
+	if (count == 0)
+		return 0;
+
+	/* nearest-rank method: */
+	unsigned rank = (p * count + 99) / 100;
+
+	return sorted[MAX2(rank, 1) - 1] / (double) (USEC_PER_SEC / MSEC_PER_SEC);
+}
+
+void get_stats(struct frame_stats *frame_stats)
+{
+	uint32_t frame_times[STATS_HISTORY];
+	unsigned count;
+
+	pthread_mutex_lock(&stats.lock);
+
+	count = MIN2(stats.frames, STATS_HISTORY);
+	for (unsigned i = 0; i < count; i++)
+		frame_times[i] = stats.frame_times[(stats.idx + STATS_HISTORY - count + i) % STATS_HISTORY];
+
+	frame_stats->frames = stats.frames;
+	frame_stats->missed = stats.missed;
+	frame_stats->max = stats.max / (double) (USEC_PER_SEC / MSEC_PER_SEC);
+	for (unsigned i = 0; i < STATS_BUCKETS; i++)
+		frame_stats->histogram[i] = stats.histogram[i];
+
+	pthread_mutex_unlock(&stats.lock);
+
+	/* sort outside the lock, not to delay the rendering thread: */
+	qsort(frame_times, count, sizeof(frame_times[0]), compare_frame_times);
+
+	frame_stats->p50 = percentile(frame_times, count, 50);
+	frame_stats->p95 = percentile(frame_times, count, 95);
+	frame_stats->p99 = percentile(frame_times, count, 99);
+}
+
+void dump_stats(void)
+{
+	struct frame_stats s;
+	unsigned last = 0;
+
+	if (stats.format == STATS_NONE)
+		return;
+
+	get_stats(&s);
+
+	for (unsigned i = 0; i < STATS_BUCKETS; i++)
+		if (s.histogram[i])
+			last = i;
+
+	if (stats.format == STATS_JSON) {
+		printf("{\"frames\": %"PRIu64", \"missed\": %"PRIu64", "
+		       "\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f, "
+		       "\"histogram\": [",
+		       s.frames, s.missed, s.p50, s.p95, s.p99, s.max);
+		for (unsigned i = 0; i <= last; i++)
+			printf("%s%"PRIu64, i ? ", " : "", s.histogram[i]);
+		printf("]}\n");
+		return;
+	}
+
+	printf("Frame times: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms, "
+	       "%"PRIu64" missed deadline(s) in %"PRIu64" frames\n",
+	       s.p50, s.p95, s.p99, s.max, s.missed, s.frames);
+	printf("Histogram:");
+	for (unsigned i = 0; i <= last; i++) {
+		if (!s.histogram[i])
+			continue;
+		printf(" %u%s ms: %"PRIu64, i, i == STATS_BUCKETS - 1 ? "+" : "", s.histogram[i]);
+	}
+	printf("\n");
+}
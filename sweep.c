@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <GLES3/gl3.h>
+
+#include "common.h"
+
+/* Module to measure how the cost of a shader scales with the number of
+ * pixels, by rendering it offscreen at a list of resolutions, e.g. to know
+ * whether a panel of a given size is feasible on a given device.
+ *
+ * The same frames, timed from their index, are rendered at each resolution,
+ * into a renderbuffer of that size, with iResolution set to it, and the
+ * throughput is measured once they are all rendered. The curve is written
+ * as CSV to the standard output, the reports being printed to stderr.
+ *
+ * The frame times are fitted, with least squares, to a fixed cost per frame
+ * plus a cost per pixel, i.e. the inverse of the fill rate. The shader is
+ * fill-bound above the number of pixels from which the cost of the pixels
+ * exceeds the fixed cost, whereas the frame time barely decreases with the
+ * resolution below it.
+ */
+
+#define MAX_SWEEP_SIZES 64
+#define SWEEP_FRAMES 100
+
+struct sweep_size {
+	unsigned width, height;
+	double frame_time;        /* in ms */
+	double fill_rate;         /* in Mpixels/s */
+};
+
+static struct {
+	struct sweep_size sizes[MAX_SWEEP_SIZES];
+	unsigned count;
+	unsigned frames;
+	unsigned fps;
+
+	int stdout_fd;  /* while the standard output is redirected to stderr */
+} sweep;
+
+int init_sweep(const struct options *options)
+{
+	const char *s = options->sweep;
+
+	while (*s) {
+		struct sweep_size *size = &sweep.sizes[sweep.count];
+		int n = 0;
+
+		if (sweep.count == MAX_SWEEP_SIZES ||
+		    sscanf(s, "%ux%u%n", &size->width, &size->height, &n) != 2 ||
+		    !size->width || !size->height || (s[n] && s[n] != ',')) {
+			printf("invalid sweep resolutions: %s\n", options->sweep);
+			return -1;
+		}
+		sweep.count++;
+		s += s[n] ? n + 1 : n;
+	}
+	if (!sweep.count) {
+		printf("invalid sweep resolutions: %s\n", options->sweep);
+		return -1;
+	}
+
+	sweep.frames = options->frames ? options->frames : SWEEP_FRAMES;
+	sweep.fps = options->fixed_fps ? options->fixed_fps : OFFLINE_FPS;
+
+	/* print the reports to stderr instead, until the curve is written: */
+	fflush(stdout);
+	sweep.stdout_fd = dup(STDOUT_FILENO);
+	if (sweep.stdout_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+		printf("failed to redirect the standard output: %s\n", strerror(errno));
+		if (sweep.stdout_fd >= 0)
+			close(sweep.stdout_fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void restore_stdout(void)
+{
+	fflush(stdout);
+	dup2(sweep.stdout_fd, STDOUT_FILENO);
+	close(sweep.stdout_fd);
+}
+
+static void render_size(const struct egl *egl, struct sweep_size *size)
+{
+	uint64_t start_time, end_time;
+	GLuint fb, rb;
+
+	glGenRenderbuffers(1, &rb);
+	glBindRenderbuffer(GL_RENDERBUFFER, rb);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size->width, size->height);
+
+	glGenFramebuffers(1, &fb);
+	glBindFramebuffer(GL_FRAMEBUFFER, fb);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rb);
+
+	glViewport(0, 0, size->width, size->height);
+	set_shadertoy_tile(size->width, size->height, 0, 0);
+
+	/* leave the allocation of the renderbuffer, etc, out: */
+	start_time = get_time_ns();
+	egl->draw(start_time, 0, start_time);
+	glFinish();
+
+	start_time = get_time_ns();
+	for (unsigned i = 0; i < sweep.frames; i++) {
+		uint64_t phase_start = profile_begin();
+		egl->draw(start_time, i, start_time + (uint64_t) i * NSEC_PER_SEC / sweep.fps);
+		profile_end(PHASE_DRAW, phase_start);
+		glFlush();
+	}
+	glFinish();
+	end_time = get_time_ns();
+
+	size->frame_time = (end_time - start_time) / (double) (NSEC_PER_SEC / MSEC_PER_SEC) / sweep.frames;
+	size->fill_rate = (double) size->width * size->height / size->frame_time / 1e3;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &fb);
+	glDeleteRenderbuffers(1, &rb);
+
+	printf("Rendered %u frames of %ux%u in %.3f ms/frame (%.1f Mpixels/s)\n",
+	       sweep.frames, size->width, size->height, size->frame_time, size->fill_rate);
+}
+
+static int compare_pixels(const void *a, const void *b)
+{
+	const struct sweep_size *x = a, *y = b;
+	uint64_t p = (uint64_t) x->width * x->height, q = (uint64_t) y->width * y->height;
+
+	return (p > q) - (p < q);
+}
+
+/* Fit the frame times to fixed + pixels / fill_rate, returning the number
+ * of pixels from which the shader is fill-bound, or 0 if it doesn't scale
+ * with the number of pixels:
+ */
+static double fit_sweep(double *fixed, double *fill_rate)
+{
+	double n = sweep.count, sp = 0, st = 0, spp = 0, spt = 0;
+
+	for (unsigned i = 0; i < sweep.count; i++) {
+		double pixels = (double) sweep.sizes[i].width * sweep.sizes[i].height;
+		double time = sweep.sizes[i].frame_time;
+
+		sp += pixels;
+		st += time;
+		spp += pixels * pixels;
+		spt += pixels * time;
+	}
+
+	double d = n * spp - sp * sp;
+	double slope = d > 0 ? (n * spt - sp * st) / d : 0;  /* in ms per pixel */
+
+	*fixed = (st - slope * sp) / n;
+	*fill_rate = slope > 0 ? 1e-3 / slope : 0;
+
+	if (slope <= 0)
+		return 0;
+
+	return MAX2(*fixed, 0) / slope;
+}
+
+int render_sweep(const struct gbm *gbm, const struct egl *egl)
+{
+	GLint max_dims[2], max_size;
+	double fixed, fill_rate, knee;
+
+	(void) gbm;
+
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_dims);
+	glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_size);
+
+	for (unsigned i = 0; i < sweep.count; i++) {
+		struct sweep_size *size = &sweep.sizes[i];
+
+		if (size->width > (unsigned) MIN2(max_dims[0], max_size) ||
+		    size->height > (unsigned) MIN2(max_dims[1], max_size)) {
+			printf("%ux%u exceeds the maximum size of %dx%d\n", size->width, size->height,
+			       MIN2(max_dims[0], max_size), MIN2(max_dims[1], max_size));
+			restore_stdout();
+			return -1;
+		}
+	}
+
+	for (unsigned i = 0; i < sweep.count; i++)
+		render_size(egl, &sweep.sizes[i]);
+
+	qsort(sweep.sizes, sweep.count, sizeof(sweep.sizes[0]), compare_pixels);
+	knee = fit_sweep(&fixed, &fill_rate);
+
+	if (sweep.count < 2) {
+		printf("Sweep at least 2 resolutions to fit the frame times\n");
+	} else if (fill_rate > 0) {
+		printf("Fixed cost of %.3f ms/frame, fill rate of %.1f Mpixels/s: fill-bound above %.0f pixels\n",
+		       MAX2(fixed, 0), fill_rate, knee);
+	} else {
+		printf("The frame time doesn't scale with the number of pixels: not fill-bound\n");
+	}
+
+	dump_profile();
+
+	restore_stdout();
+
+	printf("width,height,pixels,frame_ms,fps,mpixels_per_sec,fill_bound\n");
+	for (unsigned i = 0; i < sweep.count; i++) {
+		const struct sweep_size *size = &sweep.sizes[i];
+		unsigned pixels = size->width * size->height;
+
+		printf("%u,%u,%u,%.3f,%.1f,%.1f,%d\n",
+		       size->width, size->height, pixels, size->frame_time,
+		       MSEC_PER_SEC / size->frame_time, size->fill_rate,
+		       fill_rate > 0 && pixels >= knee);
+	}
+	fflush(stdout);
+
+	return 0;
+}
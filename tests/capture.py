@@ -0,0 +1,61 @@
+# python tests/capture.py examples/blobs.glsl
+#
+# Render headless with no frame limit, capturing the frames, interrupt it
+# with a keypress from a terminal, as the user would, and check that the
+# frames still in flight are written out, i.e. that the capture contains a
+# whole number of frames.
+
+import argparse
+import os
+import pty
+import subprocess
+import sys
+import tempfile
+import time
+
+parser = argparse.ArgumentParser(description='Test interrupting a capture')
+parser.add_argument('shader', metavar='SHADER', type=str, help='the path to the shader')
+parser.add_argument('--glsl', type=str, default='./glsl', help='the path to the glsl executable')
+parser.add_argument('--size', type=str, default='160x90', help='the size of the frames')
+parser.add_argument('--duration', type=float, default=2, help='the time to render for, in seconds')
+args = parser.parse_args()
+
+width, height = [int(n) for n in args.size.split('x')]
+
+
+def interrupt(path):
+    # only the input from a terminal interrupts the rendering:
+    master, slave = pty.openpty()
+    process = subprocess.Popen([args.glsl, '--headless=' + args.size, '--capture=' + path,
+                                args.shader], stdin=slave, stdout=subprocess.PIPE,
+                               stderr=subprocess.STDOUT)
+    os.close(slave)
+    time.sleep(args.duration)
+    os.write(master, b'\n')
+    output, _ = process.communicate(timeout=60)
+    os.close(master)
+    if process.returncode:
+        print(output.decode(), end='')
+        sys.exit('{} failed with {}'.format(path, process.returncode))
+    if b'user interrupted' not in output:
+        print(output.decode(), end='')
+        sys.exit('{} was not interrupted'.format(path))
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+with tempfile.TemporaryDirectory() as directory:
+    for ext in ['.y4m', '.nv12']:
+        frame_size = width * height * 3 // 2
+        data = interrupt(os.path.join(directory, 'capture' + ext))
+        if ext == '.y4m':
+            header, _, data = data.partition(b'\n')
+            if not header.startswith(b'YUV4MPEG2 '):
+                sys.exit('invalid Y4M header: {}'.format(header))
+            frame_size += len(b'FRAME\n')
+        if not data or len(data) % frame_size:
+            sys.exit('{}: {} bytes is not a whole number of {} byte frames'.format(
+                ext, len(data), frame_size))
+        if ext == '.y4m' and any(data[i:i + 6] != b'FRAME\n' for i in range(0, len(data), frame_size)):
+            sys.exit('{}: misaligned frame headers'.format(ext))
+        print('{}: {} whole frame(s) of {}x{}'.format(ext, len(data) // frame_size, width, height))
@@ -0,0 +1,83 @@
+# python tests/wall.py examples/blobs.glsl
+#
+# Render a video wall headless with an instance per tile, along with an
+# instance rendering the whole wall, all synced together, and check that
+# the tiles, and so their borders, match the whole wall bit for bit.
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+parser = argparse.ArgumentParser(description='Test the video wall mode')
+parser.add_argument('shader', metavar='SHADER', type=str, help='the path to the shader')
+parser.add_argument('--glsl', type=str, default='./glsl', help='the path to the glsl executable')
+parser.add_argument('--tiles', type=str, default='3x2', help='the columns and rows of tiles')
+parser.add_argument('--tile-size', type=str, default='160x90', help='the size of the tiles')
+parser.add_argument('--frames', type=int, default=10, help='the number of frames to render')
+parser.add_argument('--fixed-fps', type=int, default=0, help='time the frames from their index')
+args = parser.parse_args()
+
+columns, rows = [int(n) for n in args.tiles.split('x')]
+tile_width, tile_height = [int(n) for n in args.tile_size.split('x')]
+width, height = columns * tile_width, rows * tile_height
+instances = columns * rows + 1
+sync = '{},/glsl-wall-test-{}'.format(instances, os.getpid())
+
+
+def run(directory, name, size, x, y):
+    path = os.path.join(directory, name + '.rgba')
+    cmd = [args.glsl, '--headless=' + size, '-n', str(args.frames),
+           '--wall={}x{}+{}+{}'.format(width, height, x, y), '--wall-sync=' + sync,
+           '--capture=' + path]
+    if args.fixed_fps:
+        cmd.append('--fixed-fps={}'.format(args.fixed_fps))
+    process = subprocess.Popen(cmd + [args.shader], stdin=subprocess.DEVNULL,
+                               stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    return name, path, process
+
+
+with tempfile.TemporaryDirectory() as directory:
+    runs = [run(directory, 'wall', '{}x{}'.format(width, height), 0, 0)]
+    for row in range(rows):
+        for column in range(columns):
+            runs.append(run(directory, 'tile{}{}'.format(column, row), args.tile_size,
+                            column * tile_width, row * tile_height))
+
+    frames = {}
+    for name, path, process in runs:
+        output, _ = process.communicate()
+        if process.returncode:
+            print(output.decode(), end='')
+            sys.exit('{} failed with {}'.format(name, process.returncode))
+        with open(path, 'rb') as f:
+            frames[name] = f.read()
+
+    wall = frames['wall']
+    wall_size = width * height * 4
+    if len(wall) != wall_size * args.frames:
+        sys.exit('rendered {} frame(s) of the wall, instead of {}'.format(
+            len(wall) // wall_size, args.frames))
+
+    mismatches = 0
+    for row in range(rows):
+        for column in range(columns):
+            name = 'tile{}{}'.format(column, row)
+            tile = frames[name]
+            tile_size = tile_width * tile_height * 4
+            stride = tile_width * 4
+            for frame in range(args.frames):
+                for y in range(tile_height):
+                    offset = frame * wall_size + ((row * tile_height + y) * width + column * tile_width) * 4
+                    line = frame * tile_size + y * stride
+                    if wall[offset:offset + stride] != tile[line:line + stride]:
+                        print('{}: frame {} row {} differs from the wall'.format(name, frame, y))
+                        mismatches += 1
+                        break
+
+    if mismatches:
+        sys.exit('{} mismatch(es)'.format(mismatches))
+
+    print('{} tile(s) of {}x{} match the {}x{} wall over {} frame(s)'.format(
+        columns * rows, tile_width, tile_height, width, height, args.frames))
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2026 Antonin Stefanutti <antonin.stefanutti@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+
+/* Module to render a tile of a video wall, i.e. of a virtual viewport split
+ * across the displays of several instances, e.g. one per panel.
+ *
+ * The instances of a wall can be kept in sync through a POSIX shared memory
+ * segment, holding a barrier that the instances go through before drawing
+ * each frame, so that they all render the same frame, timed from the same
+ * origin, and the content lines up across the seams of the panels. The last
+ * instance to reach the barrier sets the time of the frame, and the first
+ * frame sets the time origin.
+ *
+ * The segment is created by the first instance, and unlinked once all the
+ * instances have attached, so that the next run starts afresh. An instance
+ * that doesn't reach the barrier in time, e.g. because it exited, breaks
+ * the sync, the others rendering on without it.
+ */
+
+#define WALL_SYNC_NAME "/glsl-wall"
+#define WALL_TIMEOUT_SEC 10
+#define WALL_START_TIMEOUT_SEC 60  /* for the other instances to compile, etc */
+
+struct wall_sync {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool ready;        /* once initialized by the first instance */
+	bool broken;
+
+	unsigned instances;
+	unsigned attached;
+	unsigned arrived;  /* at the barrier of the current frame */
+	unsigned frame;    /* the shared frame counter */
+
+	uint64_t origin;   /* of the time, in ns */
+	time_t date;       /* of the time origin */
+	uint64_t latest;   /* time of the instances arrived at the barrier */
+	uint64_t time;     /* of the last frame */
+};
+
+static struct {
+	unsigned width, height;  /* of the virtual viewport */
+	int x, y;                /* of the tile, from the top left corner */
+
+	struct wall_sync *sync;
+	char name[NAME_MAX + 1];
+	bool fixed_timing;
+} wall;
+
+static int attach_wall_sync(const char *name, unsigned instances)
+{
+	struct wall_sync *sync;
+	bool created = true;
+	int fd;
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 && errno == EEXIST) {
+		created = false;
+		fd = shm_open(name, O_RDWR, 0);
+	}
+	if (fd < 0) {
+		printf("failed to open %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	if (created && ftruncate(fd, sizeof(*sync))) {
+		printf("failed to size %s: %s\n", name, strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		return -1;
+	}
+
+	/* the segment may not be sized yet, by the instance creating it: */
+	for (unsigned i = 0; !created; i++) {
+		struct stat st;
+
+		if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(*sync))
+			break;
+		if (i == WALL_TIMEOUT_SEC * 100) {
+			printf("%s is not initialized, remove /dev/shm%s if stale\n", name, name);
+			close(fd);
+			return -1;
+		}
+		usleep(10000);
+	}
+
+	sync = mmap(NULL, sizeof(*sync), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (sync == MAP_FAILED) {
+		printf("failed to map %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	if (created) {
+		pthread_mutexattr_t mutexattr;
+		pthread_condattr_t condattr;
+
+		pthread_mutexattr_init(&mutexattr);
+		pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_SHARED);
+		pthread_mutex_init(&sync->lock, &mutexattr);
+		pthread_mutexattr_destroy(&mutexattr);
+
+		pthread_condattr_init(&condattr);
+		pthread_condattr_setpshared(&condattr, PTHREAD_PROCESS_SHARED);
+		pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+		pthread_cond_init(&sync->cond, &condattr);
+		pthread_condattr_destroy(&condattr);
+
+		sync->instances = instances;
+		__atomic_store_n(&sync->ready, true, __ATOMIC_RELEASE);
+	} else {
+		for (unsigned i = 0; !__atomic_load_n(&sync->ready, __ATOMIC_ACQUIRE); i++) {
+			if (i == WALL_TIMEOUT_SEC * 100) {
+				printf("%s is not initialized, remove /dev/shm%s if stale\n", name, name);
+				munmap(sync, sizeof(*sync));
+				return -1;
+			}
+			usleep(10000);
+		}
+	}
+
+	pthread_mutex_lock(&sync->lock);
+	if (sync->instances != instances || sync->attached == instances) {
+		printf("%s is used by a wall of %u instance(s), remove /dev/shm%s if stale\n",
+		       name, sync->instances, name);
+		pthread_mutex_unlock(&sync->lock);
+		munmap(sync, sizeof(*sync));
+		return -1;
+	}
+	/* the last instance to attach makes room for the next run: */
+	if (++sync->attached == instances)
+		shm_unlink(name);
+	printf("Attached to %s as instance %u of %u\n", name, sync->attached, instances);
+	pthread_mutex_unlock(&sync->lock);
+
+	wall.sync = sync;
+	strcpy(wall.name, name);
+
+	return 0;
+}
+
+int init_wall(const struct options *options, int width, int height)
+{
+	char name[NAME_MAX + 1] = WALL_SYNC_NAME;
+	unsigned instances = 0;
+	int n;
+
+	n = sscanf(options->wall, "%ux%u+%d+%d", &wall.width, &wall.height, &wall.x, &wall.y);
+	if (n != 4 || !wall.width || !wall.height || wall.x < 0 || wall.y < 0 ||
+	    wall.x + width > (int) wall.width || wall.y + height > (int) wall.height) {
+		printf("invalid wall geometry: %s, for a %dx%d tile\n", options->wall, width, height);
+		return -1;
+	}
+
+	/* the fragment coords start from the bottom left corner: */
+	set_shadertoy_tile(wall.width, wall.height, wall.x, wall.height - wall.y - height);
+
+	if (!options->wall_sync)
+		return 0;
+
+	n = sscanf(options->wall_sync, "%u,%254s", &instances, name + 1);
+	if (n < 1 || !instances) {
+		printf("invalid wall sync: %s\n", options->wall_sync);
+		return -1;
+	}
+	if (n == 2 && name[1] == '/')
+		memmove(name, name + 1, strlen(name));
+
+	wall.fixed_timing = options->fixed_fps != 0;
+
+	return attach_wall_sync(name, instances);
+}
+
+/* Wait for all the instances to reach the barrier, returning false if the
+ * sync is broken:
+ */
+static bool wait_wall(struct wall_sync *sync, uint64_t now)
+{
+	unsigned frame = sync->frame;
+	struct timespec timeout;
+
+	sync->latest = MAX2(sync->latest, now);
+
+	if (++sync->arrived == sync->instances) {
+		if (frame == 0) {
+			sync->origin = sync->latest;
+			sync->date = time(NULL);
+		}
+		sync->time = sync->latest;
+		sync->latest = 0;
+		sync->arrived = 0;
+		sync->frame++;
+		pthread_cond_broadcast(&sync->cond);
+		return true;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &timeout);
+	timeout.tv_sec += frame ? WALL_TIMEOUT_SEC : WALL_START_TIMEOUT_SEC;
+
+	while (sync->frame == frame && !sync->broken) {
+		if (pthread_cond_timedwait(&sync->cond, &sync->lock, &timeout) == ETIMEDOUT) {
+			sync->broken = true;
+			pthread_cond_broadcast(&sync->cond);
+		}
+	}
+
+	return sync->frame != frame;
+}
+
+void sync_wall(unsigned *frame, uint64_t *start_time, uint64_t *present_time, time_t *date)
+{
+	struct wall_sync *sync = wall.sync;
+
+	if (!sync)
+		return;
+
+	pthread_mutex_lock(&sync->lock);
+
+	if (sync->broken || !wait_wall(sync, *present_time ? *present_time : get_time_ns())) {
+		pthread_mutex_unlock(&sync->lock);
+		printf("lost the sync with the other instances of the wall\n");
+		/* not to be attached to by the next run, if not all attached: */
+		shm_unlink(wall.name);
+		munmap(sync, sizeof(*sync));
+		wall.sync = NULL;
+		return;
+	}
+
+	*frame = sync->frame - 1;
+	/* the frames are already timed from their index otherwise: */
+	if (!wall.fixed_timing) {
+		*start_time = sync->origin;
+		*present_time = sync->time;
+		*date = sync->date;
+	}
+
+	pthread_mutex_unlock(&sync->lock);
+}